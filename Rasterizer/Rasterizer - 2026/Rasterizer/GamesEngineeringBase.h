@@ -72,6 +72,15 @@ namespace GamesEngineeringBase
 		MousePressed = 2
 	};
 
+	// Enum for back buffer pixel layouts
+	// PixelRGB8 stores 3 tightly packed bytes per pixel. PixelRGBA8 stores one 32-bit word per pixel
+	// (R in the lowest byte) with every row padded to a 64 byte boundary so spans can be written with wide stores.
+	enum PixelFormat
+	{
+		PixelRGB8 = 0,
+		PixelRGBA8 = 1
+	};
+
 	// The Window class manages the creation and rendering of a window
 	class Window
 	{
@@ -98,6 +107,8 @@ namespace GamesEngineeringBase
 		unsigned int width = 0;                  // Window width
 		unsigned int height = 0;                 // Window height
 		unsigned int paddedDataSize = 0;         // Padding for backbuffer memory allocation
+		PixelFormat format = PixelRGB8;          // Layout of the back buffer
+		unsigned int pitch = 0;                  // Row length in pixels (padded for PixelRGBA8)
 
 		// Static window procedure to handle window messages
 		static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -235,7 +246,7 @@ namespace GamesEngineeringBase
 
 	public:
 		// Creates and initializes the window
-		void create(unsigned int window_width, unsigned int window_height, const std::string window_name, bool window_fullscreen = false, int window_x = 0, int window_y = 0)
+		void create(unsigned int window_width, unsigned int window_height, const std::string window_name, bool window_fullscreen = false, int window_x = 0, int window_y = 0, PixelFormat pixel_format = PixelRGB8)
 		{
 			// Window class structure
 			WNDCLASSEX wc;
@@ -366,7 +377,19 @@ namespace GamesEngineeringBase
 			devcontext->OMSetRenderTargets(1, &rtv, NULL);
 
 			// Calculate padding for GPU alignment
-			unsigned int dataSize = width * height * 3;
+			format = pixel_format;
+			unsigned int dataSize;
+			if (format == PixelRGBA8)
+			{
+				// Round rows up to 16 pixels (64 bytes) so every row starts on a cache line
+				pitch = (width + 15) & ~15u;
+				dataSize = pitch * height * 4;
+			}
+			else
+			{
+				pitch = width;
+				dataSize = width * height * 3;
+			}
 			paddedDataSize = ((dataSize + 3) / 4) * 4;
 
 			// Create buffer to hold the back buffer image
@@ -431,8 +454,26 @@ namespace GamesEngineeringBase
 				float b = ((data >> 16) & 0xFF) / 255.0; \
                 return float4(r, g, b, 1.0f);\
             }";
+			// Packed pixels are one aligned word each so no unpacking across words is needed
+			if (format == PixelRGBA8)
+			{
+				pixelShader = "ByteAddressBuffer buf : register(t0);\
+            struct VSOut\
+            {\
+                float4 pos : SV_Position;\
+            };\
+            float4 PS(VSOut psInput) : SV_Target0\
+            {\
+				uint pixelIndex = (int(psInput.pos.y) * WIDTH) + int(psInput.pos.x); \
+				uint data = buf.Load(pixelIndex * 4);\
+				float r = (data & 0xFF) / 255.0;\
+				float g = ((data >> 8) & 0xFF) / 255.0; \
+				float b = ((data >> 16) & 0xFF) / 255.0; \
+                return float4(r, g, b, 1.0f);\
+            }";
+			}
 			unsigned int startPos = 0;
-			std::string widthStr = std::to_string(width);
+			std::string widthStr = std::to_string(pitch);
 			std::string widthConst = "WIDTH";
 			startPos = static_cast<unsigned int>(pixelShader.find(widthConst, startPos));
 			pixelShader.replace(startPos, widthConst.length(), widthStr);
@@ -477,8 +518,8 @@ namespace GamesEngineeringBase
 			devcontext->PSSetShader(ps, NULL, 0);
 			devcontext->PSSetShaderResources(0, 1, &srv);
 
-			// Allocate memory for the back buffer image data
-			image = new unsigned char[paddedDataSize];
+			// Allocate memory for the back buffer image data (cache line aligned for wide stores)
+			image = static_cast<unsigned char*>(_aligned_malloc(paddedDataSize, 64));
 			clear(); // Clear the image data
 
 			// Initialize input states
@@ -505,9 +546,20 @@ namespace GamesEngineeringBase
 			return image;
 		}
 
+		// Packs an RGB color into the 32-bit word layout used by PixelRGBA8
+		static unsigned int pack(unsigned char r, unsigned char g, unsigned char b)
+		{
+			return r | (g << 8) | (b << 16) | 0xFF000000u;
+		}
+
 		// Draws a pixel at (x, y) with the specified RGB color
 		void draw(int x, int y, unsigned char r, unsigned char g, unsigned char b)
 		{
+			if (format == PixelRGBA8)
+			{
+				getRow(y)[x] = pack(r, g, b);
+				return;
+			}
 			int index = ((y * width) + x) * 3;
 			image[index] = r;
 			image[index + 1] = g;
@@ -517,6 +569,11 @@ namespace GamesEngineeringBase
 		// Draws a pixel at the specified pixel index with the given RGB color
 		void draw(int pixelIndex, unsigned char r, unsigned char g, unsigned char b)
 		{
+			if (format == PixelRGBA8)
+			{
+				draw(pixelIndex % width, pixelIndex / width, r, g, b);
+				return;
+			}
 			int index = pixelIndex * 3;
 			image[index] = r;
 			image[index + 1] = g;
@@ -526,16 +583,57 @@ namespace GamesEngineeringBase
 		// Draws a pixel at (x, y) using the color from the provided pixel array
 		void draw(int x, int y, unsigned char* pixel)
 		{
-			int index = ((y * width) + x) * 3;
-			image[index] = pixel[0];
-			image[index + 1] = pixel[1];
-			image[index + 2] = pixel[2];
+			draw(x, y, pixel[0], pixel[1], pixel[2]);
+		}
+
+		// Draws a pixel at (x, y) from an already packed color. Only valid for PixelRGBA8
+		void drawPacked(int x, int y, unsigned int pixel)
+		{
+			getRow(y)[x] = pixel;
+		}
+
+		// Writes a horizontal run of packed pixels starting at (x, y)
+		// The caller is responsible for keeping x + count within the row
+		void drawSpan(int x, int y, const unsigned int* pixels, unsigned int count)
+		{
+			if (format == PixelRGBA8)
+			{
+				memcpy(getRow(y) + x, pixels, count * sizeof(unsigned int));
+				return;
+			}
+			for (unsigned int i = 0; i < count; i++)
+			{
+				draw(x + i, y, pixels[i] & 0xFF, (pixels[i] >> 8) & 0xFF, (pixels[i] >> 16) & 0xFF);
+			}
+		}
+
+		// Writes a w x h block of packed pixels with its top left corner at (x, y)
+		// stride is the distance in pixels between rows of the source block
+		void writeTile(int x, int y, unsigned int w, unsigned int h, const unsigned int* pixels, unsigned int stride)
+		{
+			for (unsigned int i = 0; i < h; i++)
+			{
+				drawSpan(x, y + i, pixels + (i * stride), w);
+			}
+		}
+
+		// Returns a pointer to the first packed pixel of row y. Only valid for PixelRGBA8
+		unsigned int* getRow(int y) const
+		{
+			return reinterpret_cast<unsigned int*>(image) + (y * pitch);
 		}
 
 		// Clears the back buffer by setting all pixels to black
 		void clear()
 		{
-			memset(image, 0, width * height * 3 * sizeof(unsigned char));
+			memset(image, 0, paddedDataSize * sizeof(unsigned char));
+		}
+
+		// Clears rows y0 to y1 - 1 of the back buffer (lets several threads each clear a band)
+		void clearRows(unsigned int y0, unsigned int y1)
+		{
+			unsigned int rowBytes = (format == PixelRGBA8) ? pitch * 4 : width * 3;
+			memset(image + (size_t)y0 * rowBytes, 0, (size_t)(y1 - y0) * rowBytes);
 		}
 
 		// Presents the back buffer to the screen
@@ -570,6 +668,18 @@ namespace GamesEngineeringBase
 			return height;
 		}
 
+		// Returns the row length of the back buffer in pixels
+		unsigned int getPitch() const
+		{
+			return pitch;
+		}
+
+		// Returns the layout of the back buffer
+		PixelFormat getPixelFormat() const
+		{
+			return format;
+		}
+
 		// Provide raw access to back buffer
 		// There are no checks done on this so any writes to this buffer should be within bounds
 		// Can be used for screenshots
@@ -677,6 +787,7 @@ namespace GamesEngineeringBase
 			sc->Release();
 			devcontext->Release();
 			dev->Release();
+			_aligned_free(image);
 			CoUninitialize();
 		}
 	};
@@ -15,6 +15,11 @@ public:
         return instance;
     }
 
+    // Restart the sequence from a fixed seed (benchmarks - every run sees the same numbers)
+    void seed(unsigned int value) {
+        rng.seed(value);
+    }
+
     // Generate a random integer within a range
     int getRandomInt(int min, int max) {
         std::uniform_int_distribution<int> distribution(min, max);
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Fixed length scene run for the benchmark runner.
+// A scene calls frame() at the top of its loop; the first warmUp frames are not timed (bin size
+// calibration, caches), then the time of every frame is kept until frames have been recorded.
+class BenchRun {
+public:
+    int warmUp = 30;
+    int frames = 300;
+    std::vector<double> frameMs;
+
+    BenchRun(int _frames, int _warmUp = 30) : warmUp(_warmUp), frames(_frames) {
+        frameMs.reserve(frames);
+    }
+
+    // Start of a frame - records the previous one, returns false when the run is over
+    bool frame() {
+        auto now = std::chrono::high_resolution_clock::now();
+        if (count > warmUp) frameMs.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+        count++;
+        return (int)frameMs.size() < frames;
+    }
+
+private:
+    int count = 0;
+    std::chrono::high_resolution_clock::time_point last;
+};
+
+// Frame time summary of one benchmark (ms)
+struct BenchResult {
+    double mean = 0, p50 = 0, p95 = 0, p99 = 0;
+
+    // Summarise frame times (nearest rank percentiles)
+    static BenchResult from(std::vector<double> ms) {
+        BenchResult r;
+        if (ms.empty()) return r;
+        std::sort(ms.begin(), ms.end());
+        for (double t : ms) r.mean += t;
+        r.mean /= ms.size();
+        //nearest rank: the smallest sample with at least p of the samples at or below it, ceil(p * n) (1 based)
+        //the epsilon stops rounding error in p * n (0.07 * 100 = 7.000000000000001) moving it up a rank
+        auto rank = [&](double p) {
+            size_t k = (size_t)std::ceil(p * ms.size() - 1e-9);
+            return ms[std::clamp<size_t>(k, 1, ms.size()) - 1];
+        };
+        r.p50 = rank(0.50);
+        r.p95 = rank(0.95);
+        r.p99 = rank(0.99);
+        return r;
+    }
+};
+
+// Named results, stored as JSON: { "name": { "mean": 1.0, "p50": 1.0, "p95": 1.0, "p99": 1.0 }, ... }
+class BenchBaseline {
+public:
+    std::map<std::string, BenchResult> results;
+
+    // Read a baseline written by save (returns false if there is no file or it does not parse)
+    bool load(const std::string& filename) {
+        std::ifstream in(filename);
+        if (!in) return false;
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string s = ss.str();
+        results.clear();
+
+        //flat two level object - names and field keys are strings, values are numbers
+        size_t i = s.find('{');
+        if (i == std::string::npos) return false;
+        std::string name;
+        while ((i = s.find('"', i + 1)) != std::string::npos) {
+            size_t close = s.find('"', i + 1);
+            if (close == std::string::npos) return false;
+            std::string key = s.substr(i + 1, close - i - 1);
+            size_t colon = s.find(':', close);
+            if (colon == std::string::npos) return false;
+            size_t v = s.find_first_not_of(" \t\r\n", colon + 1);
+            if (v == std::string::npos) return false;
+            if (s[v] == '{') {
+                name = key;
+                results[name] = BenchResult();
+                i = v;
+                continue;
+            }
+            double value = std::strtod(s.c_str() + v, nullptr);
+            BenchResult& r = results[name];
+            if (key == "mean") r.mean = value;
+            else if (key == "p50") r.p50 = value;
+            else if (key == "p95") r.p95 = value;
+            else if (key == "p99") r.p99 = value;
+            i = v;
+        }
+        return true;
+    }
+
+    bool save(const std::string& filename) const {
+        std::ofstream out(filename);
+        if (!out) return false;
+        out << "{\n";
+        size_t n = 0;
+        for (const auto& [name, r] : results) {
+            out << "  \"" << name << "\": { \"mean\": " << r.mean << ", \"p50\": " << r.p50 << ", \"p95\": " << r.p95 << ", \"p99\": " << r.p99 << " }"
+                << (++n < results.size() ? ",\n" : "\n");
+        }
+        out << "}\n";
+        return (bool)out;
+    }
+
+    // Print every result next to its baseline
+    // Input Variables:
+    // - current: Results of this run
+    // - threshold: Allowed slow down (0.05 = 5%) of the mean and p95 before it counts as a regression
+    // Returns the number of regressions.
+    int compare(const BenchBaseline& current, double threshold) const {
+        int regressions = 0;
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-24s %9s %9s %9s %9s %9s\n", "benchmark", "mean", "p50", "p95", "p99", "vs base");
+        std::cout << line;
+        for (const auto& [name, r] : current.results) {
+            auto base = results.find(name);
+            std::string verdict = "new";
+            if (base != results.end() && base->second.mean > 0) {
+                double change = r.mean / base->second.mean - 1.0;
+                bool slower = r.mean > base->second.mean * (1.0 + threshold) || r.p95 > base->second.p95 * (1.0 + threshold);
+                char pct[32];
+                std::snprintf(pct, sizeof(pct), "%+.1f%%", change * 100.0);
+                verdict = std::string(pct) + (slower ? " REGRESSED" : "");
+                regressions += slower;
+            }
+            std::snprintf(line, sizeof(line), "%-24s %9.3f %9.3f %9.3f %9.3f %s\n", name.c_str(), r.mean, r.p50, r.p95, r.p99, verdict.c_str());
+            std::cout << line;
+        }
+        return regressions;
+    }
+};
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GamesEngineeringBase.h"
+#include "profiler.h"
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// What captured frames are written as
+enum class CaptureFormat {
+    PPM, // one binary PPM file per frame
+    PNG, // one PNG file per frame (stored, not compressed - no zlib needed)
+    Raw  // every frame appended to one stream as packed RGB bytes, e.g. for ffmpeg -f rawvideo -pix_fmt rgb24
+};
+
+// Frame capture sink. Renderer::present hands every finished frame to submit(), which copies the
+// canvas into a free slot of a ring and returns - a background thread turns the slots into files
+// (or a raw video stream) so the render loop never waits on the disk. When every slot is still
+// waiting to be written the frame is dropped (counted), or, in lossless mode, the render thread
+// waits for the writer. Slots keep their memory, so capturing allocates nothing per frame.
+class FrameCapture {
+public:
+    static FrameCapture& instance() {
+        static FrameCapture capture;
+        return capture;
+    }
+
+    // Pick the format from a path's extension (.ppm, .png, anything else is a raw stream)
+    static CaptureFormat formatFor(const std::string& path) {
+        auto endsWith = [&](const char* ext) {
+            size_t n = std::strlen(ext);
+            return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+        };
+        if (endsWith(".ppm") || endsWith(".PPM")) return CaptureFormat::PPM;
+        if (endsWith(".png") || endsWith(".PNG")) return CaptureFormat::PNG;
+        return CaptureFormat::Raw;
+    }
+
+    // Start capturing
+    // Input Variables:
+    // - _path: PPM / PNG - file name with exactly one %d for the frame number, optionally zero padded
+    //          ("frames/f%05d.png", %% for a literal %), Raw - the stream's file ("-" = stdout)
+    // - _format: Output format
+    // - slots: Frames buffered between the render thread and the writer
+    // - _lossless: Wait for the writer instead of dropping frames when the ring is full
+    // Returns false if capture is already running, a PPM / PNG name is not a valid pattern or the raw
+    // stream could not be opened.
+    bool start(const std::string& _path, CaptureFormat _format, unsigned int slots = 8, bool _lossless = false) {
+        if (running) return false;
+        if (_format != CaptureFormat::Raw && !parseName(_path)) return false;
+        path = _path;
+        format = _format;
+        lossless = _lossless;
+        if (format == CaptureFormat::Raw) {
+            if (path == "-") {
+#if defined(_WIN32)
+                _setmode(_fileno(stdout), _O_BINARY);
+#endif
+                stream = stdout;
+            }
+            else stream = std::fopen(path.c_str(), "wb");
+            if (!stream) return false;
+        }
+        ring = std::vector<Slot>(std::max(slots, 1u));
+        head = tail = queued = 0;
+        frame = written = dropped = failed = 0;
+        quit = false;
+        running = true;
+        writer = std::thread([this]() {
+            Profiler::instance().nameThread("capture");
+            writeLoop();
+        });
+        return true;
+    }
+
+    bool active() const {
+        return running;
+    }
+
+    // Copy a finished frame into the ring (render thread)
+    // Returns false if the frame was dropped (or capture is off).
+    bool submit(GamesEngineeringBase::Window& canvas) {
+        if (!running) return false;
+        PROFILE_ZONE("capture");
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (queued == ring.size()) {
+                if (!lossless) {
+                    frame++;
+                    dropped++;
+                    return false;
+                }
+                freed.wait(lock, [this]() { return queued < ring.size(); });
+            }
+        }
+
+        //the slot at head is the render thread's until it is queued
+        Slot& s = ring[head];
+        s.width = canvas.getWidth();
+        s.height = canvas.getHeight();
+        s.packed = canvas.getPixelFormat() == GamesEngineeringBase::PixelRGBA8;
+        s.frame = frame++;
+        size_t rowBytes = (size_t)s.width * (s.packed ? 4 : 3);
+        s.pixels.resize(rowBytes * s.height);
+        for (unsigned int y = 0; y < s.height; y++) {
+            const unsigned char* row = s.packed ? reinterpret_cast<const unsigned char*>(canvas.getRow(y)) : canvas.getBackBuffer() + y * rowBytes;
+            std::memcpy(s.pixels.data() + y * rowBytes, row, rowBytes);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            head = (head + 1) % ring.size();
+            queued++;
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    // Write everything still queued, then stop the writer and close the stream
+    void stop() {
+        if (!running) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        ready.notify_one();
+        writer.join();
+        if (stream && stream != stdout) std::fclose(stream);
+        else if (stream) std::fflush(stream);
+        stream = nullptr;
+        running = false;
+        std::cerr << "capture: " << written << " frames written, " << dropped << " dropped";
+        if (failed) std::cerr << ", " << failed << " failed";
+        std::cerr << "\n";
+    }
+
+    unsigned long long framesWritten() const {
+        return written;
+    }
+
+    unsigned long long framesDropped() const {
+        return dropped;
+    }
+
+    ~FrameCapture() {
+        stop();
+    }
+
+private:
+    // One buffered frame, copied row by row from the canvas (no padding)
+    struct Slot {
+        std::vector<unsigned char> pixels;
+        unsigned int width = 0, height = 0;
+        bool packed = true; // 4 bytes per pixel (PixelRGBA8), otherwise 3
+        unsigned long long frame = 0;
+    };
+
+    std::string path;
+    std::string namePrefix, nameSuffix; //PPM / PNG file name either side of the frame number
+    unsigned int numberWidth = 0;       //minimum digits of the frame number
+    char numberPad = ' ';               //'0' for %0Nd
+    CaptureFormat format = CaptureFormat::PPM;
+    bool lossless = false;
+    bool running = false;
+    FILE* stream = nullptr;
+    std::thread writer;
+
+    std::vector<Slot> ring;
+    size_t head = 0, tail = 0, queued = 0; //render thread fills head, writer empties tail
+    bool quit = false;
+    std::mutex mutex;
+    std::condition_variable ready; //a slot was queued (or quit)
+    std::condition_variable freed; //a slot was written
+
+    unsigned long long frame = 0;   //frames submitted, including dropped ones (numbers the files)
+    std::atomic<unsigned long long> written{ 0 };
+    std::atomic<unsigned long long> dropped{ 0 };
+    std::atomic<unsigned long long> failed{ 0 };
+
+    std::vector<unsigned char> rgb;       //writer scratch - one frame of RGB bytes
+    std::vector<unsigned char> scanlines; //writer scratch - PNG rows with their filter bytes
+    std::vector<unsigned char> encoded;   //writer scratch - PNG file
+
+    //the writer profiles through Profiler::instance(), so make sure it is constructed first - statics are destroyed
+    //in reverse order, which keeps it alive through ~FrameCapture and any atexit stop() registered after instance()
+    FrameCapture() {
+        Profiler::instance();
+    }
+
+    // Writer thread - encode queued slots in order until stopped and drained
+    void writeLoop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this]() { return quit || queued > 0; });
+                if (queued == 0) return;
+            }
+            //the slot at tail is the writer's until it is released
+            if (write(ring[tail])) written++;
+            else failed++;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tail = (tail + 1) % ring.size();
+                queued--;
+            }
+            freed.notify_one();
+        }
+    }
+
+    bool write(const Slot& s) {
+        PROFILE_ZONE("capture write");
+        size_t count = (size_t)s.width * s.height;
+        rgb.resize(count * 3);
+        if (s.packed) {
+            //R in the lowest byte of every word
+            for (size_t i = 0; i < count; i++) {
+                rgb[i * 3] = s.pixels[i * 4];
+                rgb[i * 3 + 1] = s.pixels[i * 4 + 1];
+                rgb[i * 3 + 2] = s.pixels[i * 4 + 2];
+            }
+        }
+        else std::memcpy(rgb.data(), s.pixels.data(), count * 3);
+
+        if (format == CaptureFormat::Raw)
+            return std::fwrite(rgb.data(), 1, rgb.size(), stream) == rgb.size();
+
+        std::string number = std::to_string(s.frame);
+        std::string name = namePrefix;
+        if (number.size() < numberWidth) name.append(numberWidth - number.size(), numberPad);
+        name += number;
+        name += nameSuffix;
+        FILE* f = std::fopen(name.c_str(), "wb");
+        if (!f) return false;
+        bool ok;
+        if (format == CaptureFormat::PPM) {
+            std::fprintf(f, "P6\n%u %u\n255\n", s.width, s.height);
+            ok = std::fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+        }
+        else {
+            encodePNG(s.width, s.height);
+            ok = std::fwrite(encoded.data(), 1, encoded.size(), f) == encoded.size();
+        }
+        return std::fclose(f) == 0 && ok;
+    }
+
+    // Split a PPM / PNG file name pattern around its frame number: exactly one %d or %<width>d / %0<width>d,
+    // %% for a literal %, any other % is an error. The name is built by hand in write(), the pattern is
+    // never handed to printf.
+    bool parseName(const std::string& pattern) {
+        std::string parts[2];
+        int conversions = 0;
+        unsigned int width = 0;
+        char pad = ' ';
+        for (size_t i = 0; i < pattern.size(); i++) {
+            if (pattern[i] != '%') {
+                parts[conversions] += pattern[i];
+                continue;
+            }
+            if (++i < pattern.size() && pattern[i] == '%') {
+                parts[conversions] += '%';
+                continue;
+            }
+            if (conversions == 1) return false;
+            if (i < pattern.size() && pattern[i] == '0') {
+                pad = '0';
+                i++;
+            }
+            while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9') {
+                width = width * 10 + (pattern[i] - '0');
+                if (width > 20) return false;
+                i++;
+            }
+            if (i >= pattern.size() || pattern[i] != 'd') return false;
+            conversions = 1;
+        }
+        if (conversions != 1) return false;
+        namePrefix = parts[0];
+        nameSuffix = parts[1];
+        numberWidth = width;
+        numberPad = pad;
+        return true;
+    }
+
+    // PNG of the frame in rgb: 8 bit RGB, every row unfiltered, the zlib stream made of stored
+    // (uncompressed) deflate blocks
+    void encodePNG(unsigned int width, unsigned int height) {
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        encoded.assign(signature, signature + 8);
+
+        unsigned char ihdr[13] = {};
+        put32(ihdr, width);
+        put32(ihdr + 4, height);
+        ihdr[8] = 8; //bit depth
+        ihdr[9] = 2; //colour type RGB
+        chunk("IHDR", ihdr, 13);
+
+        //rows, each after a filter byte 0 (none)
+        size_t rowBytes = (size_t)width * 3;
+        scanlines.resize((rowBytes + 1) * height);
+        for (unsigned int y = 0; y < height; y++) {
+            scanlines[y * (rowBytes + 1)] = 0;
+            std::memcpy(&scanlines[y * (rowBytes + 1) + 1], &rgb[y * rowBytes], rowBytes);
+        }
+
+        //zlib stream written straight into the IDAT chunk (length and CRC filled in after)
+        size_t start = encoded.size();
+        encoded.resize(start + 8);
+        std::memcpy(&encoded[start + 4], "IDAT", 4);
+        encoded.push_back(0x78);
+        encoded.push_back(0x01);
+        size_t total = scanlines.size();
+        for (size_t done = 0; done < total;) {
+            size_t n = std::min<size_t>(total - done, 65535);
+            unsigned char header[5] = { (unsigned char)(done + n == total ? 1 : 0), //final block flag, type 0 (stored)
+                (unsigned char)(n & 0xff), (unsigned char)(n >> 8), (unsigned char)(~n & 0xff), (unsigned char)((~n >> 8) & 0xff) };
+            encoded.insert(encoded.end(), header, header + 5);
+            encoded.insert(encoded.end(), scanlines.begin() + done, scanlines.begin() + done + n);
+            done += n;
+        }
+        unsigned char adler[4];
+        put32(adler, adler32(scanlines.data(), total));
+        encoded.insert(encoded.end(), adler, adler + 4);
+        size_t length = encoded.size() - start - 8;
+        put32(&encoded[start], (unsigned int)length);
+        unsigned char crc[4];
+        put32(crc, crc32(&encoded[start + 4], length + 4));
+        encoded.insert(encoded.end(), crc, crc + 4);
+
+        chunk("IEND", nullptr, 0);
+    }
+
+    // Append a PNG chunk (length, type, data, CRC of type and data)
+    void chunk(const char* type, const unsigned char* data, size_t n) {
+        size_t start = encoded.size();
+        encoded.resize(start + 8 + n + 4);
+        put32(&encoded[start], (unsigned int)n);
+        std::memcpy(&encoded[start + 4], type, 4);
+        if (n) std::memcpy(&encoded[start + 8], data, n);
+        put32(&encoded[start + 8 + n], crc32(&encoded[start + 4], n + 4));
+    }
+
+    static void put32(unsigned char* p, unsigned int v) {
+        p[0] = (unsigned char)(v >> 24);
+        p[1] = (unsigned char)(v >> 16);
+        p[2] = (unsigned char)(v >> 8);
+        p[3] = (unsigned char)v;
+    }
+
+    static unsigned int adler32(const unsigned char* p, size_t n) {
+        unsigned int a = 1, b = 0;
+        while (n > 0) {
+            size_t run = std::min<size_t>(n, 5552); //largest run before the sums can overflow
+            for (size_t i = 0; i < run; i++) {
+                a += p[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            p += run;
+            n -= run;
+        }
+        return (b << 16) | a;
+    }
+
+    static unsigned int crc32(const unsigned char* p, size_t n) {
+        static const std::vector<unsigned int> table = []() {
+            std::vector<unsigned int> t(256);
+            for (unsigned int i = 0; i < 256; i++) {
+                unsigned int c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        unsigned int c = 0xffffffffu;
+        for (size_t i = 0; i < n; i++) c = table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+        return c ^ 0xffffffffu;
+    }
+};
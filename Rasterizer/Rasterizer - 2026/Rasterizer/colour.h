@@ -2,17 +2,31 @@
 
 #include <cmath>
 #include <cstdint>
+#include <algorithm>
+#include <immintrin.h>
+#include "dispatch.h"
 
 // The `colour` class represents an RGB colour with floating-point precision.
 // It provides various utilities for manipulating and converting colours.
-class colour {
+// Stored in one 16-byte aligned SSE register (the fourth lane is padding, kept at 0), so the
+// arithmetic and the byte conversion are single SSE instructions.
+class alignas(16) colour {
     union {
         struct {
             float r, g, b; // Red, Green, and Blue components of the colour
+            float pad;     // Unused fourth lane
         };
         float rgb[3];     // Array representation of the RGB components
+        __m128 m;         // SSE register (r, g, b, pad)
     };
 
+    explicit colour(__m128 v) : m(v) {}
+
+    // Components clamped to [0, 1] (operand order matches std::clamp for -0 and NaN)
+    __m128 clamped() const {
+        return _mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_setzero_ps(), m));
+    }
+
 public:
     // Enum for indexing the RGB components
     enum Colour { RED = 0, GREEN = 1, BLUE = 2 };
@@ -23,7 +37,7 @@ public:
     // - _r: Red component (default 0.0f)
     // - _g: Green component (default 0.0f)
     // - _b: Blue component (default 0.0f)
-    colour(float _r = 0, float _g = 0, float _b = 0) : r(_r), g(_g), b(_b) {}
+    colour(float _r = 0, float _g = 0, float _b = 0) : m(_mm_setr_ps(_r, _g, _b, 0.0f)) {}
 
     // Sets the RGB components of the colour.
     // Input Variables:
@@ -38,66 +52,139 @@ public:
     // Returns a reference to the specified component.
     float& operator[] (Colour c) { return rgb[c]; }
 
+    // Reads the specified component of the colour by index (const version).
+    // Input Variables:
+    // - c: Index of the component (RED, GREEN, or BLUE)
+    // Returns the value of the specified component.
+    float operator[] (Colour c) const { return rgb[c]; }
+
     // Assigns the values of another colour to this one.
     // Input Variables:
     // - c: The source color
     void operator = (colour c) {
-        r = c.r;
-        g = c.g;
-        b = c.b;
+        m = c.m;
     }
 
     // Clamps the RGB components of the colour to the range [0, 1].
     void clampColour() {
-        r = std::min(r, 1.0f);
-        g = std::min(g, 1.0f);
-        b = std::min(b, 1.0f);
+        m = clamped();
     }
 
     // Converts the floating-point RGB values to integer values (0-255).
+    // Components are saturated first, so truncation gives the same result as floor.
     // Output Variables:
     // - cr: Red component as an unsigned char
     // - cg: Green component as an unsigned char
     // - cb: Blue component as an unsigned char
-    void toRGB(unsigned char& cr, unsigned char& cg, unsigned char& cb) {
-        cr = static_cast<unsigned char>(std::floor(r * 255));
-        cg = static_cast<unsigned char>(std::floor(g * 255));
-        cb = static_cast<unsigned char>(std::floor(b * 255));
+    void toRGB(unsigned char& cr, unsigned char& cg, unsigned char& cb) const {
+        unsigned int p = toPacked();
+        cr = static_cast<unsigned char>(p);
+        cg = static_cast<unsigned char>(p >> 8);
+        cb = static_cast<unsigned char>(p >> 16);
+    }
+
+    // Converts the colour to a packed 32-bit pixel (R in the lowest byte, alpha 255).
+    // Returns the packed pixel.
+    unsigned int toPacked() const {
+        __m128i i = _mm_cvttps_epi32(_mm_mul_ps(clamped(), _mm_set1_ps(255.0f)));
+        i = _mm_packs_epi32(i, i);   // 32 -> 16 bit, values are 0 - 255 so nothing saturates
+        i = _mm_packus_epi16(i, i);  // 16 -> 8 bit: bytes r, g, b, pad
+        return (static_cast<unsigned int>(_mm_cvtsi128_si32(i)) & 0x00FFFFFFu) | 0xFF000000u;
     }
 
     // Scales the RGB components of the colour by a scalar value.
     // Input Variables:
     // - scalar: The scaling factor
     // Returns a new `colour` object with scaled components.
-    colour operator * (const float scalar) {
-        colour c;
-        c.r = r * scalar;
-        c.g = g * scalar;
-        c.b = b * scalar;
-        return c;
+    colour operator * (const float scalar) const {
+        return colour(_mm_mul_ps(m, _mm_set1_ps(scalar)));
     }
 
     // Multiplies the RGB components of this colour with another colour.
     // Input Variables:
     // - col: The other color to multiply with
     // Returns a new `colour` object with multiplied components.
-    colour operator * (const colour& col) {
-        colour c;
-        c.r = r * col.r;
-        c.g = g * col.g;
-        c.b = b * col.b;
-        return c;
+    colour operator * (const colour& col) const {
+        return colour(_mm_mul_ps(m, col.m));
     }
 
     // Adds the RGB components of another colour to this one.
     // Input Variables:
     // - _c: The other colour to add
     // Returns a new `colour` object with added components.
-    colour operator + (const colour& _c) {
-        colour c;
-        c.r = r + _c.r;
-        c.g = g + _c.g;
-        c.b = b + _c.b;
-        return c;
+    colour operator + (const colour& _c) const {
+        return colour(_mm_add_ps(m, _c.m));
+    }
+};
+
+// The `colour4` class holds four colours in SoA form (one SSE register per channel)
+// so shading can run on four pixels at once.
+class colour4 {
+public:
+    __m128 r, g, b; // Red, Green and Blue for each of the four lanes
+
+    // Constructor to initialize all lanes to black.
+    colour4() : r(_mm_setzero_ps()), g(_mm_setzero_ps()), b(_mm_setzero_ps()) {}
+
+    // Constructor to initialize the lanes from channel registers.
+    // Input Variables:
+    // - _r, _g, _b: Channel values for the four lanes
+    colour4(__m128 _r, __m128 _g, __m128 _b) : r(_r), g(_g), b(_b) {}
+
+    // Constructor to broadcast a single colour to all four lanes.
+    // Input Variables:
+    // - c: Colour to broadcast
+    explicit colour4(colour c)
+        : r(_mm_set1_ps(c[colour::RED])), g(_mm_set1_ps(c[colour::GREEN])), b(_mm_set1_ps(c[colour::BLUE])) {}
+
+    // Scales every lane by a per-lane factor.
+    // Input Variables:
+    // - s: Scaling factor for each lane
+    // Returns a new `colour4` with scaled components.
+    colour4 operator * (__m128 s) const {
+        return colour4(_mm_mul_ps(r, s), _mm_mul_ps(g, s), _mm_mul_ps(b, s));
+    }
+
+    // Multiplies the lanes component-wise with another `colour4`.
+    // Input Variables:
+    // - c: The other colours to multiply with
+    // Returns a new `colour4` with multiplied components.
+    colour4 operator * (const colour4& c) const {
+        return colour4(_mm_mul_ps(r, c.r), _mm_mul_ps(g, c.g), _mm_mul_ps(b, c.b));
+    }
+
+    // Adds the lanes of another `colour4`.
+    // Input Variables:
+    // - c: The other colours to add
+    // Returns a new `colour4` with added components.
+    colour4 operator + (const colour4& c) const {
+        return colour4(_mm_add_ps(r, c.r), _mm_add_ps(g, c.g), _mm_add_ps(b, c.b));
+    }
+
+    // Converts one channel register to integers in [0, 255] with saturation.
+    static __m128i toByte(__m128 v) {
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+    }
+
+    // Converts the four lanes to packed 32-bit pixels (same layout as colour::toPacked).
+    // Returns the four packed pixels in one register.
+    __m128i toPacked() const {
+        __m128i pr = toByte(r);
+        __m128i pg = _mm_slli_epi32(toByte(g), 8);
+        __m128i pb = _mm_slli_epi32(toByte(b), 16);
+        __m128i pa = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+        return _mm_or_si128(_mm_or_si128(pr, pg), _mm_or_si128(pb, pa));
+    }
+
+    // Converts separate float channel arrays into packed pixels (4, 8 or 16 per step, whichever
+    // the CPU supports).
+    // Input Variables:
+    // - red, green, blue: Channel arrays of length count
+    // - count: Number of pixels to convert
+    // Output Variables:
+    // - out: Packed pixels
+    static void packSpan(const float* red, const float* green, const float* blue, unsigned int* out, unsigned int count) {
+        SimdKernels::active().packColours(red, green, blue, out, count);
     }
 };
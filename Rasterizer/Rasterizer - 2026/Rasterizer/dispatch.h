@@ -0,0 +1,479 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Runtime CPU feature dispatch.
+// The binary is built for the x64 baseline (SSE2). Wider versions of the batch kernels are compiled
+// alongside it (MSVC accepts AVX intrinsics anywhere, GCC/Clang get a per function target attribute)
+// and the best set the CPU and OS support is picked once at startup, so one build runs on old and new
+// machines alike. Every version rounds exactly like the SSE2 one (no FMA contraction, same summation
+// order), so images do not depend on the machine.
+#if defined(_MSC_VER)
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#elif defined(__clang__)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+//GCC's avx512f target brings FMA with it and would fuse the separate multiply and add intrinsics
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+
+// Instruction set of a kernel table (ordered, later is wider)
+enum class SimdLevel { SSE2, AVX2, AVX512 };
+
+inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    default: return "sse2";
+    }
+}
+
+// What the CPU (and the OS, for the wider register state) supports
+struct CpuFeatures {
+    bool sse41 = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool fma = false;
+    bool avx512f = false;
+
+    // Query cpuid and xgetbv (AVX registers are only usable if the OS saves them on a context switch)
+    static CpuFeatures detect() {
+        CpuFeatures f;
+        unsigned int r1[4] = {}, r7[4] = {};
+        cpuid(0, 0, r1);
+        unsigned int maxLeaf = r1[0];
+        cpuid(1, 0, r1);
+        if (maxLeaf >= 7) cpuid(7, 0, r7);
+
+        f.sse41 = (r1[2] >> 19) & 1;
+        bool osxsave = (r1[2] >> 27) & 1;
+        unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+        bool ymm = (xcr0 & 0x6) == 0x6;    // SSE and AVX state
+        bool zmm = (xcr0 & 0xE6) == 0xE6;  // plus opmask and the upper 16 / upper halves of the ZMM registers
+        f.avx = ymm && ((r1[2] >> 28) & 1);
+        f.fma = f.avx && ((r1[2] >> 12) & 1);
+        f.avx2 = f.avx && ((r7[1] >> 5) & 1);
+        f.avx512f = zmm && f.avx2 && ((r7[1] >> 16) & 1);
+        return f;
+    }
+
+    // Widest kernel table this machine can run
+    SimdLevel best() const {
+        if (avx512f) return SimdLevel::AVX512;
+        if (avx2) return SimdLevel::AVX2;
+        return SimdLevel::SSE2;
+    }
+
+private:
+    static void cpuid(unsigned int leaf, unsigned int sub, unsigned int (&regs)[4]) {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, (int)leaf, (int)sub);
+        for (int i = 0; i < 4; i++) regs[i] = (unsigned int)r[i];
+#else
+        __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    static unsigned long long xgetbv() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        unsigned int lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return ((unsigned long long)hi << 32) | lo;
+#endif
+    }
+};
+
+// Table of the hot batch kernels for one instruction set.
+// active() is the table used by the renderer - the best one for this machine unless select() chose
+// another (call select between frames, e.g. to compare levels in a benchmark).
+class SimdKernels {
+public:
+    SimdLevel level = SimdLevel::SSE2;
+
+    // Set count floats to value (depth clear)
+    void (*fill)(float* dst, size_t count, float value) = nullptr;
+
+    // Project points held as SoA streams: p = (x, y, z, 1) * m with m read as a row major matrix on the
+    // right (out.x = x * m[0] + y * m[4] + z * m[8] + m[12] ...), divide by w, map to a w x h viewport
+    // (y flipped). z is left in NDC.
+    void (*projectPoints)(const float* m, const float* x, const float* y, const float* z,
+        float* ox, float* oy, float* oz, size_t count, float width, float height) = nullptr;
+
+    // out[i] = m * in[i] for count vec4s (4 floats each, 16-byte aligned) - same result as matrix * vec4
+    void (*transformVec4)(const float* m, const float* in, float* out, size_t count) = nullptr;
+
+    // Pack float channels (saturated to [0, 1], NaN to 0) into RGBA8 pixels, alpha 255 - same result as colour4::toPacked
+    void (*packColours)(const float* red, const float* green, const float* blue, unsigned int* out, size_t count) = nullptr;
+
+    // Build count row major world matrices T * R * S (16 floats each, 16-byte aligned) from SoA streams
+    // t = translation, q = unit rotation quaternion, s = uniform scale
+    void (*buildTRS)(const float* tx, const float* ty, const float* tz, const float* qx, const float* qy, const float* qz,
+        const float* qw, const float* s, float* out, size_t count) = nullptr;
+
+    // Kernel table for a level (falls back to the widest supported level below it)
+    static SimdKernels forLevel(SimdLevel want) {
+        static const CpuFeatures features = CpuFeatures::detect();
+        if (want > features.best()) want = features.best();
+        SimdKernels k;
+        k.level = want;
+        k.fill = fillSSE2;
+        k.projectPoints = projectSSE2;
+        k.transformVec4 = transformSSE2;
+        k.packColours = packSSE2;
+        k.buildTRS = trsSSE2;
+        if (want >= SimdLevel::AVX2) {
+            k.fill = fillAVX2;
+            k.projectPoints = projectAVX2;
+            k.transformVec4 = transformAVX2;
+            k.packColours = packAVX2;
+            k.buildTRS = trsAVX2;
+        }
+        if (want >= SimdLevel::AVX512) {
+            k.fill = fillAVX512;
+            k.projectPoints = projectAVX512;
+            k.transformVec4 = transformAVX512;
+            k.packColours = packAVX512;
+            //buildTRS stays AVX2 - eight matrices per step already fill the store bandwidth
+        }
+        return k;
+    }
+
+    static const SimdKernels& active() {
+        return table();
+    }
+
+    // Use a narrower (or the best) level from now on
+    static void select(SimdLevel level) {
+        table() = forLevel(level);
+    }
+
+private:
+    static SimdKernels& table() {
+        static SimdKernels kernels = forLevel(SimdLevel::AVX512);
+        return kernels;
+    }
+
+    // Scalar tails - same operations and order as the vector bodies
+
+    static void projectScalar(const float* m, const float* x, const float* y, const float* z,
+        float* ox, float* oy, float* oz, size_t i, size_t count, float width, float height) {
+        for (; i < count; i++) {
+            float rx = (x[i] * m[0] + y[i] * m[4]) + (z[i] * m[8] + m[12]);
+            float ry = (x[i] * m[1] + y[i] * m[5]) + (z[i] * m[9] + m[13]);
+            float rz = (x[i] * m[2] + y[i] * m[6]) + (z[i] * m[10] + m[14]);
+            float rw = (x[i] * m[3] + y[i] * m[7]) + (z[i] * m[11] + m[15]);
+            ox[i] = ((rx / rw + 1.0f) * 0.5f) * width;
+            oy[i] = height - ((ry / rw + 1.0f) * 0.5f) * height;
+            oz[i] = rz / rw;
+        }
+    }
+
+    static unsigned int packScalar(float r, float g, float b) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_setr_ps(r, g, b, 0.0f), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        __m128i i = _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+        i = _mm_packus_epi16(_mm_packs_epi32(i, i), i);
+        return ((unsigned int)_mm_cvtsi128_si32(i) & 0x00FFFFFFu) | 0xFF000000u;
+    }
+
+    // SSE2
+
+    static void fillSSE2(float* dst, size_t count, float value) {
+        __m128 v = _mm_set1_ps(value);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            _mm_storeu_ps(dst + i, v);
+            _mm_storeu_ps(dst + i + 4, v);
+            _mm_storeu_ps(dst + i + 8, v);
+            _mm_storeu_ps(dst + i + 12, v);
+        }
+        for (; i < count; i++) dst[i] = value;
+    }
+
+    static void projectSSE2(const float* m, const float* x, const float* y, const float* z,
+        float* ox, float* oy, float* oz, size_t count, float width, float height) {
+        __m128 c[16];
+        for (int k = 0; k < 16; k++) c[k] = _mm_set1_ps(m[k]);
+        __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), vw = _mm_set1_ps(width), vh = _mm_set1_ps(height);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+            __m128 r[4];
+            for (int k = 0; k < 4; k++)
+                r[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, c[k]), _mm_mul_ps(py, c[4 + k])), _mm_add_ps(_mm_mul_ps(pz, c[8 + k]), c[12 + k]));
+            _mm_storeu_ps(ox + i, _mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_div_ps(r[0], r[3]), one), half), vw));
+            _mm_storeu_ps(oy + i, _mm_sub_ps(vh, _mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_div_ps(r[1], r[3]), one), half), vh)));
+            _mm_storeu_ps(oz + i, _mm_div_ps(r[2], r[3]));
+        }
+        projectScalar(m, x, y, z, ox, oy, oz, i, count, width, height);
+    }
+
+    static void transformSSE2(const float* m, const float* in, float* out, size_t count) {
+        __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        for (size_t i = 0; i < count; i++) {
+            __m128 v = _mm_load_ps(in + i * 4);
+            __m128 s = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+            s = _mm_add_ps(s, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+            _mm_store_ps(out + i * 4, _mm_add_ps(s, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)))));
+        }
+    }
+
+    static void packSSE2(const float* red, const float* green, const float* blue, unsigned int* out, size_t count) {
+        __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+        __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i r = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(red + i), zero), one), scale));
+            __m128i g = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(green + i), zero), one), scale));
+            __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(blue + i), zero), one), scale));
+            __m128i p = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), p);
+        }
+        for (; i < count; i++) out[i] = packScalar(red[i], green[i], blue[i]);
+    }
+
+    // quaternion -> rotation * scale, one matrix per lane (m[r * 3 + c] holds element [r][c] of every lane's matrix)
+    static void trsRowsSSE2(__m128 qx, __m128 qy, __m128 qz, __m128 qw, __m128 s, __m128 (&m)[9]) {
+        __m128 two = _mm_set1_ps(2.0f), one = _mm_set1_ps(1.0f);
+        __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+        m[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), s);
+        m[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), s);
+        m[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), s);
+        m[3] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), s);
+        m[4] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), s);
+        m[5] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), s);
+        m[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), s);
+        m[7] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), s);
+        m[8] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), s);
+    }
+
+    static void trsSSE2(const float* tx, const float* ty, const float* tz, const float* qx, const float* qy, const float* qz,
+        const float* qw, const float* s, float* out, size_t count) {
+        __m128 row3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        for (size_t i = 0; i < count; i += 4) {
+            //last group - copy what is left into a block padded with identity transforms
+            size_t n = count - i < 4 ? count - i : 4;
+            alignas(16) float pad[8][4] = { {}, {}, {}, {}, {}, {}, { 1, 1, 1, 1 }, { 1, 1, 1, 1 } };
+            const float* src[8] = { tx + i, ty + i, tz + i, qx + i, qy + i, qz + i, qw + i, s + i };
+            if (n < 4) {
+                for (int k = 0; k < 8; k++) {
+                    for (size_t j = 0; j < n; j++) pad[k][j] = src[k][j];
+                    src[k] = pad[k];
+                }
+            }
+            __m128 m[9];
+            trsRowsSSE2(_mm_loadu_ps(src[3]), _mm_loadu_ps(src[4]), _mm_loadu_ps(src[5]), _mm_loadu_ps(src[6]), _mm_loadu_ps(src[7]), m);
+            __m128 rows[3][4];
+            for (int r = 0; r < 3; r++) {
+                rows[r][0] = m[r * 3];
+                rows[r][1] = m[r * 3 + 1];
+                rows[r][2] = m[r * 3 + 2];
+                rows[r][3] = _mm_loadu_ps(src[r]);
+                _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+            }
+            for (size_t j = 0; j < n; j++) {
+                float* o = out + (i + j) * 16;
+                _mm_store_ps(o, rows[0][j]);
+                _mm_store_ps(o + 4, rows[1][j]);
+                _mm_store_ps(o + 8, rows[2][j]);
+                _mm_store_ps(o + 12, row3);
+            }
+        }
+    }
+
+    // AVX2 (8 lanes)
+
+    SIMD_TARGET_AVX2 static void fillAVX2(float* dst, size_t count, float value) {
+        __m256 v = _mm256_set1_ps(value);
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32) {
+            _mm256_storeu_ps(dst + i, v);
+            _mm256_storeu_ps(dst + i + 8, v);
+            _mm256_storeu_ps(dst + i + 16, v);
+            _mm256_storeu_ps(dst + i + 24, v);
+        }
+        for (; i + 8 <= count; i += 8) _mm256_storeu_ps(dst + i, v);
+        for (; i < count; i++) dst[i] = value;
+        _mm256_zeroupper();
+    }
+
+    SIMD_TARGET_AVX2 static void projectAVX2(const float* m, const float* x, const float* y, const float* z,
+        float* ox, float* oy, float* oz, size_t count, float width, float height) {
+        __m256 c[16];
+        for (int k = 0; k < 16; k++) c[k] = _mm256_set1_ps(m[k]);
+        __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f), vw = _mm256_set1_ps(width), vh = _mm256_set1_ps(height);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+            __m256 r[4];
+            for (int k = 0; k < 4; k++)
+                r[k] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, c[k]), _mm256_mul_ps(py, c[4 + k])), _mm256_add_ps(_mm256_mul_ps(pz, c[8 + k]), c[12 + k]));
+            _mm256_storeu_ps(ox + i, _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(r[0], r[3]), one), half), vw));
+            _mm256_storeu_ps(oy + i, _mm256_sub_ps(vh, _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(r[1], r[3]), one), half), vh)));
+            _mm256_storeu_ps(oz + i, _mm256_div_ps(r[2], r[3]));
+        }
+        _mm256_zeroupper();
+        projectScalar(m, x, y, z, ox, oy, oz, i, count, width, height);
+    }
+
+    // two vec4s per register - the columns are repeated in both 128-bit halves
+    SIMD_TARGET_AVX2 static void transformAVX2(const float* m, const float* in, float* out, size_t count) {
+        __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        __m256 d0 = _mm256_set_m128(c0, c0), d1 = _mm256_set_m128(c1, c1), d2 = _mm256_set_m128(c2, c2), d3 = _mm256_set_m128(c3, c3);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            __m256 v = _mm256_loadu_ps(in + i * 4);
+            __m256 s = _mm256_add_ps(_mm256_mul_ps(d0, _mm256_permute_ps(v, 0x00)), _mm256_mul_ps(d1, _mm256_permute_ps(v, 0x55)));
+            s = _mm256_add_ps(s, _mm256_mul_ps(d2, _mm256_permute_ps(v, 0xAA)));
+            _mm256_storeu_ps(out + i * 4, _mm256_add_ps(s, _mm256_mul_ps(d3, _mm256_permute_ps(v, 0xFF))));
+        }
+        _mm256_zeroupper();
+        if (i < count) transformSSE2(m, in + i * 4, out + i * 4, count - i);
+    }
+
+    SIMD_TARGET_AVX2 static void packAVX2(const float* red, const float* green, const float* blue, unsigned int* out, size_t count) {
+        __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(255.0f);
+        __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i r = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(red + i), zero), one), scale));
+            __m256i g = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(green + i), zero), one), scale));
+            __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(blue + i), zero), one), scale));
+            __m256i p = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), alpha));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), p);
+        }
+        _mm256_zeroupper();
+        if (i < count) packSSE2(red + i, green + i, blue + i, out + i, count - i);
+    }
+
+    SIMD_TARGET_AVX2 static void trsRowsAVX2(__m256 qx, __m256 qy, __m256 qz, __m256 qw, __m256 s, __m256 (&m)[9]) {
+        __m256 two = _mm256_set1_ps(2.0f), one = _mm256_set1_ps(1.0f);
+        __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+        __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+        __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+        m[0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), s);
+        m[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), s);
+        m[2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), s);
+        m[3] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), s);
+        m[4] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), s);
+        m[5] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), s);
+        m[6] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), s);
+        m[7] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), s);
+        m[8] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), s);
+    }
+
+    // the 4x4 transposes work inside each 128-bit half: the low half holds matrices 0 - 3, the high half 4 - 7
+    SIMD_TARGET_AVX2 static void trsAVX2(const float* tx, const float* ty, const float* tz, const float* qx, const float* qy, const float* qz,
+        const float* qw, const float* s, float* out, size_t count) {
+        __m256 row3 = _mm256_setr_ps(0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 m[9];
+            trsRowsAVX2(_mm256_loadu_ps(qx + i), _mm256_loadu_ps(qy + i), _mm256_loadu_ps(qz + i), _mm256_loadu_ps(qw + i), _mm256_loadu_ps(s + i), m);
+            const float* t[3] = { tx + i, ty + i, tz + i };
+            __m256 rows[3][4];
+            for (int r = 0; r < 3; r++) {
+                __m256 a = m[r * 3], b = m[r * 3 + 1], c = m[r * 3 + 2], d = _mm256_loadu_ps(t[r]);
+                __m256 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpacklo_ps(c, d);
+                __m256 t2 = _mm256_unpackhi_ps(a, b), t3 = _mm256_unpackhi_ps(c, d);
+                rows[r][0] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+                rows[r][1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+                rows[r][2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+                rows[r][3] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+            }
+            for (int j = 0; j < 4; j++) {
+                float* lo = out + (i + j) * 16;
+                float* hi = out + (i + j + 4) * 16;
+                _mm256_storeu_ps(lo, _mm256_permute2f128_ps(rows[0][j], rows[1][j], 0x20));
+                _mm256_storeu_ps(lo + 8, _mm256_permute2f128_ps(rows[2][j], row3, 0x20));
+                _mm256_storeu_ps(hi, _mm256_permute2f128_ps(rows[0][j], rows[1][j], 0x31));
+                _mm256_storeu_ps(hi + 8, _mm256_permute2f128_ps(rows[2][j], row3, 0x31));
+            }
+        }
+        _mm256_zeroupper();
+        if (i < count) trsSSE2(tx + i, ty + i, tz + i, qx + i, qy + i, qz + i, qw + i, s + i, out + i * 16, count - i);
+    }
+
+    // AVX-512 (16 lanes, masked tails)
+
+    SIMD_TARGET_AVX512 static void fillAVX512(float* dst, size_t count, float value) {
+        __m512 v = _mm512_set1_ps(value);
+        size_t i = 0;
+        for (; i + 64 <= count; i += 64) {
+            _mm512_storeu_ps(dst + i, v);
+            _mm512_storeu_ps(dst + i + 16, v);
+            _mm512_storeu_ps(dst + i + 32, v);
+            _mm512_storeu_ps(dst + i + 48, v);
+        }
+        for (; i + 16 <= count; i += 16) _mm512_storeu_ps(dst + i, v);
+        if (i < count) _mm512_mask_storeu_ps(dst + i, (__mmask16)((1u << (count - i)) - 1), v);
+        _mm256_zeroupper();
+    }
+
+    SIMD_TARGET_AVX512 static void projectAVX512(const float* m, const float* x, const float* y, const float* z,
+        float* ox, float* oy, float* oz, size_t count, float width, float height) {
+        __m512 c[16];
+        for (int k = 0; k < 16; k++) c[k] = _mm512_set1_ps(m[k]);
+        __m512 one = _mm512_set1_ps(1.0f), half = _mm512_set1_ps(0.5f), vw = _mm512_set1_ps(width), vh = _mm512_set1_ps(height);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m512 px = _mm512_loadu_ps(x + i), py = _mm512_loadu_ps(y + i), pz = _mm512_loadu_ps(z + i);
+            __m512 r[4];
+            for (int k = 0; k < 4; k++)
+                r[k] = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(px, c[k]), _mm512_mul_ps(py, c[4 + k])), _mm512_add_ps(_mm512_mul_ps(pz, c[8 + k]), c[12 + k]));
+            _mm512_storeu_ps(ox + i, _mm512_mul_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_div_ps(r[0], r[3]), one), half), vw));
+            _mm512_storeu_ps(oy + i, _mm512_sub_ps(vh, _mm512_mul_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_div_ps(r[1], r[3]), one), half), vh)));
+            _mm512_storeu_ps(oz + i, _mm512_div_ps(r[2], r[3]));
+        }
+        _mm256_zeroupper();
+        projectScalar(m, x, y, z, ox, oy, oz, i, count, width, height);
+    }
+
+    // four vec4s per register
+    SIMD_TARGET_AVX512 static void transformAVX512(const float* m, const float* in, float* out, size_t count) {
+        __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        __m512 d0 = _mm512_broadcast_f32x4(c0), d1 = _mm512_broadcast_f32x4(c1), d2 = _mm512_broadcast_f32x4(c2), d3 = _mm512_broadcast_f32x4(c3);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m512 v = _mm512_loadu_ps(in + i * 4);
+            __m512 s = _mm512_add_ps(_mm512_mul_ps(d0, _mm512_permute_ps(v, 0x00)), _mm512_mul_ps(d1, _mm512_permute_ps(v, 0x55)));
+            s = _mm512_add_ps(s, _mm512_mul_ps(d2, _mm512_permute_ps(v, 0xAA)));
+            _mm512_storeu_ps(out + i * 4, _mm512_add_ps(s, _mm512_mul_ps(d3, _mm512_permute_ps(v, 0xFF))));
+        }
+        _mm256_zeroupper();
+        if (i < count) transformSSE2(m, in + i * 4, out + i * 4, count - i);
+    }
+
+    SIMD_TARGET_AVX512 static void packAVX512(const float* red, const float* green, const float* blue, unsigned int* out, size_t count) {
+        __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f), scale = _mm512_set1_ps(255.0f);
+        __m512i alpha = _mm512_set1_epi32((int)0xFF000000u);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m512i r = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(red + i), zero), one), scale));
+            __m512i g = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(green + i), zero), one), scale));
+            __m512i b = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(blue + i), zero), one), scale));
+            __m512i p = _mm512_or_si512(_mm512_or_si512(r, _mm512_slli_epi32(g, 8)), _mm512_or_si512(_mm512_slli_epi32(b, 16), alpha));
+            _mm512_storeu_si512(out + i, p);
+        }
+        _mm256_zeroupper();
+        if (i < count) packSSE2(red + i, green + i, blue + i, out + i, count - i);
+    }
+};
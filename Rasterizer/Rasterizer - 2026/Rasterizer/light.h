@@ -10,3 +10,16 @@ struct Light {
     colour ambient; // ambient light component 
 };
 
+// type of a local (positional) light
+enum class LightType { Point, Spot };
+
+// point or spot light - influence falls smoothly to zero at radius
+struct LocalLight {
+    LightType type = LightType::Point;
+    vec4 position;          // world position (w = 1)
+    vec4 direction = vec4(0.f, -1.f, 0.f, 0.f); // spot direction (w = 0), unused for points
+    colour L;               // light colour
+    float radius = 5.0f;    // range of the light
+    float cosInner = 0.9f;  // spot - full intensity inside this cone
+    float cosOuter = 0.8f;  // spot - no light outside this cone
+};
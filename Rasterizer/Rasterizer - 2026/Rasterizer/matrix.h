@@ -3,14 +3,34 @@
 #include <iostream>
 #include <vector>
 #include "vec4.h"
+#include "dispatch.h"
 
 // Matrix class for 4x4 transformation matrices
-class matrix {
+// Row major, 16-byte aligned with one SSE register per row. Products are computed with SSE in the
+// same order as the scalar formulas (row . column summed left to right), so they are bit-identical.
+class alignas(16) matrix {
     union {
         float m[4][4]; // 2D array representation of the matrix
         float a[16];   // 1D array representation of the matrix for linear access
+        __m128 r[4];   // SSE register per row
     };
 
+    // Columns of the matrix (transposed rows) - lane i of column k is m[i][k]
+    void columns(__m128 (&c)[4]) const {
+        c[0] = r[0];
+        c[1] = r[1];
+        c[2] = r[2];
+        c[3] = r[3];
+        _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+    }
+
+    // c0 * v.x + c1 * v.y + c2 * v.z + c3 * v.w, summed left to right
+    static __m128 combine(const __m128 (&c)[4], __m128 v) {
+        __m128 s = _mm_add_ps(_mm_mul_ps(c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+        s = _mm_add_ps(s, _mm_mul_ps(c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+        return _mm_add_ps(s, _mm_mul_ps(c[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+    }
+
 public:
     // Default constructor initializes the matrix as an identity matrix
     matrix() {
@@ -19,6 +39,18 @@ public:
 
     // Access matrix elements by row and column
     float& operator()(unsigned int row, unsigned int col) { return m[row][col]; }
+    float operator()(unsigned int row, unsigned int col) const { return m[row][col]; }
+
+    // True if every element has the same bits (used to tell whether a cached product is still valid)
+    bool operator == (const matrix& mx) const {
+        __m128i eq = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi32(_mm_castps_si128(r[0]), _mm_castps_si128(mx.r[0])), _mm_cmpeq_epi32(_mm_castps_si128(r[1]), _mm_castps_si128(mx.r[1]))),
+            _mm_and_si128(_mm_cmpeq_epi32(_mm_castps_si128(r[2]), _mm_castps_si128(mx.r[2])), _mm_cmpeq_epi32(_mm_castps_si128(r[3]), _mm_castps_si128(mx.r[3]))));
+        return _mm_movemask_epi8(eq) == 0xFFFF;
+    }
+
+    bool operator != (const matrix& mx) const {
+        return !(*this == mx);
+    }
 
     // Display the matrix elements in a readable format
     void display() {
@@ -34,12 +66,20 @@ public:
     // - v: vec4 object to multiply with the matrix
     // Returns the resulting transformed vec4
     vec4 operator * (const vec4& v) const {
-        vec4 result;
-        result[0] = a[0] * v[0] + a[1] * v[1] + a[2] * v[2] + a[3] * v[3];
-        result[1] = a[4] * v[0] + a[5] * v[1] + a[6] * v[2] + a[7] * v[3];
-        result[2] = a[8] * v[0] + a[9] * v[1] + a[10] * v[2] + a[11] * v[3];
-        result[3] = a[12] * v[0] + a[13] * v[1] + a[14] * v[2] + a[15] * v[3];
-        return result;
+        __m128 c[4];
+        columns(c);
+        return vec4(combine(c, v.simd()));
+    }
+
+    // Multiply an array of vectors by the matrix (the transpose is done once for the whole array,
+    // several vectors per register where the CPU has AVX2 / AVX-512)
+    // Input Variables:
+    // - in: Vectors to transform
+    // - count: Number of vectors
+    // Output Variables:
+    // - out: Transformed vectors (may be the same array as in)
+    void transform(const vec4* in, vec4* out, size_t count) const {
+        SimdKernels::active().transformVec4(a, reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
     }
 
     // Multiply the matrix by another matrix
@@ -47,16 +87,10 @@ public:
     // - mx: Another matrix to multiply with
     // Returns the resulting matrix
     matrix operator * (const matrix& mx) const {
+        //row i of the result = row i of this combined with the rows of mx
         matrix ret;
-        for (int row = 0; row < 4; ++row) {
-            for (int col = 0; col < 4; ++col) {
-                ret.a[row * 4 + col] =
-                    a[row * 4 + 0] * mx.a[0 * 4 + col] +
-                    a[row * 4 + 1] * mx.a[1 * 4 + col] +
-                    a[row * 4 + 2] * mx.a[2 * 4 + col] +
-                    a[row * 4 + 3] * mx.a[3 * 4 + col];
-            }
-        }
+        for (int row = 0; row < 4; ++row)
+            ret.r[row] = combine(mx.r, r[row]);
         return ret;
     }
 
@@ -140,7 +174,23 @@ public:
     // - x, y, z: Rotation angles in radians around each axis
     // Returns the composite rotation matrix
     static matrix makeRotateXYZ(float x, float y, float z) {
-        return matrix::makeRotateX(x) * matrix::makeRotateY(y) * matrix::makeRotateZ(z);
+        //makeRotateX(x) * makeRotateY(y) * makeRotateZ(z) written out (the products with 0 and 1
+        //drop away, the remaining terms are rounded in the same order, so the result is identical)
+        float cx = std::cos(x), sx = std::sin(x);
+        float cy = std::cos(y), sy = std::sin(y);
+        float cz = std::cos(z), sz = std::sin(z);
+        float sxsy = sx * sy, cxsy = -(cx * sy);
+        matrix m;
+        m.a[0] = cy * cz;
+        m.a[1] = -(cy * sz);
+        m.a[2] = sy;
+        m.a[4] = sxsy * cz + cx * sz;
+        m.a[5] = sxsy * -sz + cx * cz;
+        m.a[6] = -(sx * cy);
+        m.a[8] = cxsy * cz + sx * sz;
+        m.a[9] = cxsy * -sz + sx * cz;
+        m.a[10] = cx * cy;
+        return m;
     }
 
     // Create a scaling matrix
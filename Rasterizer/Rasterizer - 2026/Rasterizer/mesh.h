@@ -2,15 +2,160 @@
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include "vec4.h"
 #include "matrix.h"
 #include "colour.h"
 
+class Texture;
+
+// Array storage for mesh data: either an owned std::vector, or a view of memory owned by someone
+// else (a memory mapped mesh file - see MeshIO::loadBinary). Reads are a plain pointer index either
+// way. Anything that changes the size turns a view into an owned copy first; element writes to a
+// view go to the memory it points at (mesh files are mapped copy-on-write, so the file is untouched).
+// Copying a buffer always gives an owned copy, so writes to it never show through another mesh;
+// moving a view hands the view over.
+template <typename T>
+class MeshBuffer {
+public:
+    MeshBuffer() = default;
+
+    MeshBuffer(const MeshBuffer& o) : owned(o.begin(), o.end()) {
+        sync(o);
+    }
+
+    MeshBuffer(MeshBuffer&& o) noexcept : owned(std::move(o.owned)), backing(std::move(o.backing)) {
+        sync(o);
+        o.reset();
+    }
+
+    MeshBuffer& operator = (const MeshBuffer& o) {
+        if (this != &o) {
+            owned.assign(o.begin(), o.end());
+            backing.reset();
+            sync(o);
+        }
+        return *this;
+    }
+
+    MeshBuffer& operator = (MeshBuffer&& o) noexcept {
+        if (this != &o) {
+            owned = std::move(o.owned);
+            backing = std::move(o.backing);
+            sync(o);
+            o.reset();
+        }
+        return *this;
+    }
+
+    // Point at count elements owned elsewhere
+    // Input Variables:
+    // - data: First element
+    // - count: Number of elements
+    // - keep: Keeps the memory alive for as long as any buffer views it
+    void view(T* data, size_t count, std::shared_ptr<const void> keep) {
+        owned = std::vector<T>();
+        backing = std::move(keep);
+        ptr = data;
+        n = count;
+    }
+
+    // True if the elements live in external memory
+    bool isView() const {
+        return backing != nullptr;
+    }
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    T& operator [] (size_t i) { return ptr[i]; }
+    const T& operator [] (size_t i) const { return ptr[i]; }
+    T* begin() { return ptr; }
+    T* end() { return ptr + n; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + n; }
+
+    void clear() {
+        if (isView()) view(nullptr, 0, nullptr);
+        owned.clear();
+        n = 0;
+    }
+
+    void reserve(size_t count) {
+        own();
+        owned.reserve(count);
+        ptr = owned.data();
+    }
+
+    void resize(size_t count) {
+        own();
+        owned.resize(count);
+        ptr = owned.data();
+        n = count;
+    }
+
+    void push_back(const T& v) {
+        own();
+        owned.push_back(v);
+        ptr = owned.data();
+        n = owned.size();
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        own();
+        T& v = owned.emplace_back(std::forward<Args>(args)...);
+        ptr = owned.data();
+        n = owned.size();
+        return v;
+    }
+
+    // Exchange contents with a vector (a view is copied into the vector)
+    void swap(std::vector<T>& other) {
+        own();
+        owned.swap(other);
+        ptr = owned.data();
+        n = owned.size();
+    }
+
+private:
+    std::vector<T> owned;
+    std::shared_ptr<const void> backing; // set for a view
+    T* ptr = nullptr;
+    size_t n = 0;
+
+    // Pointer and size after copying or moving the storage from o
+    void sync(const MeshBuffer& o) {
+        ptr = backing ? o.ptr : owned.data();
+        n = o.n;
+    }
+
+    void reset() {
+        owned.clear();
+        backing.reset();
+        ptr = nullptr;
+        n = 0;
+    }
+
+    // Copy a view into owned storage
+    void own() {
+        if (!isView()) return;
+        std::vector<T> copy(ptr, ptr + n);
+        backing.reset();
+        owned.swap(copy);
+        ptr = owned.data();
+    }
+};
+
 // Represents a vertex in a 3D mesh, including its position, normal, and color
 struct Vertex {
     vec4 p;         // Position of the vertex in 3D space
     vec4 normal;    // Normal vector for the vertex
     colour rgb;     // Color of the vertex
+    float uv[2] = { 0.f, 0.f }; // Texture coordinates (only used by textured meshes)
 };
 
 // Stores indices of vertices that form a triangle in a mesh
@@ -25,15 +170,42 @@ struct triIndices {
     }
 };
 
+// A cluster of up to maxTriangles neighbouring triangles of a mesh (a contiguous run of Mesh::triangles).
+// The geometry stage schedules and culls per meshlet, so a large mesh spreads across workers and
+// parts that are off screen or facing away are skipped without transforming their vertices.
+struct Meshlet {
+    static constexpr unsigned int maxTriangles = 64;
+
+    unsigned int firstTri = 0;  // first triangle of the run
+    unsigned int triCount = 0;  // number of triangles
+    vec4 centre;                // bounding sphere (object space, w = 1)
+    float radius = 0.f;
+    vec4 coneAxis = vec4(0.f, 0.f, 0.f, 0.f); // average front facing direction (w = 0)
+    float coneSin = 1.f;        // sine of the widest angle between the axis and a triangle normal
+    bool hasCone = false;       // false if the normals spread over more than a hemisphere
+};
+
+// Lighting model used when rasterizing a mesh (cheapest first)
+enum class ShadingModel {
+    Unlit,   // Vertex colours only
+    Flat,    // One lit colour per triangle
+    Gouraud, // Lit per vertex, interpolated per pixel
+    Phong,   // Normal interpolated and lit per pixel
+    Textured // Phong with the vertex colour modulated by the mesh texture
+};
+
 // Class representing a 3D mesh made up of vertices and triangles
 class Mesh {
 public:
     colour col;       // Uniform color for the mesh
     float kd;         // Diffuse reflection coefficient
     float ka;         // Ambient reflection coefficient
+    ShadingModel shading = ShadingModel::Phong; // Lighting model for this mesh
+    const Texture* texture = nullptr; // Texture for ShadingModel::Textured (not owned)
     matrix world;     // Transformation matrix for the mesh
-    std::vector<Vertex> vertices;       // List of vertices in the mesh
-    std::vector<triIndices> triangles;  // List of triangles in the mesh
+    MeshBuffer<Vertex> vertices;        // List of vertices in the mesh
+    MeshBuffer<triIndices> triangles;   // List of triangles in the mesh
+    MeshBuffer<Meshlet> meshlets;       // Triangle clusters (built by buildMeshlets)
 
 
     //FRUSTRUM CULLING
@@ -75,6 +247,16 @@ public:
         vertices.push_back(v);
     }
 
+    // Add a vertex with texture coordinates
+    // Input Variables:
+    // - vertex: Position of the vertex
+    // - normal: Normal vector for the vertex
+    // - u, v: Texture coordinates
+    void addVertex(const vec4& vertex, const vec4& normal, float u, float v) {
+        Vertex vert = { vertex, normal, col, { u, v } };
+        vertices.push_back(vert);
+    }
+
     // Add a triangle to the mesh
     // Input Variables:
     // - v1, v2, v3: Indices of the vertices forming the triangle
@@ -82,6 +264,47 @@ public:
         triangles.emplace_back(v1, v2, v3);
     }
 
+    // Split the mesh into meshlets of at most maxTris triangles (call again after editing the geometry).
+    // Triangles are split recursively at the median of their centroid or normal (whichever spreads
+    // most), so every meshlet is a compact patch of surface facing roughly one way - small spheres and
+    // narrow normal cones cull better. Triangles are reordered so each meshlet is a contiguous run.
+    // Input Variables:
+    // - maxTris: Largest meshlet (triangles)
+    void buildMeshlets(unsigned int maxTris = Meshlet::maxTriangles) {
+        meshlets.clear();
+        if (triangles.empty()) return;
+        unsigned int count = (unsigned int)triangles.size();
+
+        //split keys - centroid, and face normal scaled to a quarter of the mesh size
+        float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+        for (const auto& v : vertices)
+            for (unsigned int k = 0; k < 3; k++) {
+                lo[k] = std::min(lo[k], v.p[k]);
+                hi[k] = std::max(hi[k], v.p[k]);
+            }
+        float normalWeight = 0.25f * std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+
+        std::vector<SplitKey> keys(count);
+        for (unsigned int i = 0; i < count; i++) {
+            const auto& t = triangles[i];
+            vec4 n = faceNormal(t);
+            for (unsigned int k = 0; k < 3; k++) {
+                keys[i].key[k] = (vertices[t.v[0]].p[k] + vertices[t.v[1]].p[k] + vertices[t.v[2]].p[k]) / 3.f;
+                keys[i].key[3 + k] = n[k] * normalWeight;
+            }
+            keys[i].tri = i;
+        }
+        splitMeshlets(keys, 0, count, maxTris);
+
+        std::vector<triIndices> sorted;
+        sorted.reserve(count);
+        for (const auto& key : keys) sorted.push_back(triangles[key.tri]);
+        triangles.swap(sorted);
+
+        for (auto& m : meshlets)
+            setBounds(m);
+    }
+
     // Display the vertices and triangles of the mesh
     void display() const {
         std::cout << "Vertices and Normals:\n";
@@ -119,15 +342,46 @@ public:
         normal.normalise();
 
         // Add vertices with the calculated normal
-        mesh.addVertex(v1, normal);
-        mesh.addVertex(v2, normal);
-        mesh.addVertex(v3, normal);
-        mesh.addVertex(v4, normal);
+        mesh.addVertex(v1, normal, 0.f, 0.f);
+        mesh.addVertex(v2, normal, 1.f, 0.f);
+        mesh.addVertex(v3, normal, 1.f, 1.f);
+        mesh.addVertex(v4, normal, 0.f, 1.f);
 
         // Add two triangles forming the rectangle
         mesh.addTriangle(0, 2, 1);
         mesh.addTriangle(0, 3, 2);
 
+        mesh.buildMeshlets();
+        return mesh;
+    }
+
+    // Generate a flat grid in the XZ plane facing +y (split up so the near plane only rejects a few cells)
+    // Input Variables:
+    // - size: Length of one side
+    // - divisions: Number of cells along each side
+    // - uvRepeat: Number of times the texture repeats along each side
+    // Returns a Mesh object representing the plane
+    static Mesh makePlane(float size, int divisions, float uvRepeat) {
+        Mesh mesh;
+        float half = size / 2.0f;
+        vec4 normal(0, 1, 0, 0);
+        for (int z = 0; z <= divisions; ++z) {
+            for (int x = 0; x <= divisions; ++x) {
+                float fx = (float)x / divisions, fz = (float)z / divisions;
+                mesh.addVertex(vec4(-half + fx * size, 0, -half + fz * size), normal, fx * uvRepeat, fz * uvRepeat);
+            }
+        }
+        for (int z = 0; z < divisions; ++z) {
+            for (int x = 0; x < divisions; ++x) {
+                int v0 = z * (divisions + 1) + x;
+                int v1 = v0 + 1;
+                int v2 = v0 + divisions + 1;
+                int v3 = v2 + 1;
+                mesh.addTriangle(v0, v1, v2);
+                mesh.addTriangle(v1, v3, v2);
+            }
+        }
+        mesh.buildMeshlets();
         return mesh;
     }
 
@@ -176,11 +430,11 @@ public:
             int v2 = faceIndices[i][2];
             int v3 = faceIndices[i][3];
 
-            // Add vertices with their normals
-            mesh.addVertex(positions[v0], normals[i]);
-            mesh.addVertex(positions[v1], normals[i]);
-            mesh.addVertex(positions[v2], normals[i]);
-            mesh.addVertex(positions[v3], normals[i]);
+            // Add vertices with their normals (each face maps the whole texture)
+            mesh.addVertex(positions[v0], normals[i], 0.f, 1.f);
+            mesh.addVertex(positions[v1], normals[i], 1.f, 1.f);
+            mesh.addVertex(positions[v2], normals[i], 1.f, 0.f);
+            mesh.addVertex(positions[v3], normals[i], 0.f, 0.f);
 
             // Add two triangles for the face
             int baseIndex = i * 4;
@@ -188,6 +442,7 @@ public:
             mesh.addTriangle(baseIndex, baseIndex + 3, baseIndex + 2);
         }
         //mesh.calculateSphereRad(); //FRUSTRUM CULLING
+        mesh.buildMeshlets();
         return mesh;
     }
 
@@ -228,7 +483,7 @@ public:
                 normal.normalise();
                 normal[3] = 0.f;
 
-                mesh.addVertex(position, normal);
+                mesh.addVertex(position, normal, (float)lon / longitudeDivisions, (float)lat / latitudeDivisions);
             }
         }
 
@@ -245,6 +500,93 @@ public:
             }
         }
         mesh.calculateSphereRad(); //FRUSTRUM CULLING
+        mesh.buildMeshlets();
         return mesh;
     }
+
+private:
+    // Triangle position/orientation used to split meshlets
+    struct SplitKey {
+        float key[6]; // centroid xyz, weighted normal xyz
+        unsigned int tri;
+    };
+
+    // Halve keys[begin, end) at the median of its widest key until every part fits a meshlet,
+    // then record the parts in order (bounds are filled in afterwards)
+    void splitMeshlets(std::vector<SplitKey>& keys, unsigned int begin, unsigned int end, unsigned int maxTris) {
+        if (end - begin <= maxTris) {
+            Meshlet m;
+            m.firstTri = begin;
+            m.triCount = end - begin;
+            meshlets.push_back(m);
+            return;
+        }
+        unsigned int axis = 0;
+        float widest = -1.f;
+        for (unsigned int k = 0; k < 6; k++) {
+            float lo = 1e30f, hi = -1e30f;
+            for (unsigned int i = begin; i < end; i++) {
+                lo = std::min(lo, keys[i].key[k]);
+                hi = std::max(hi, keys[i].key[k]);
+            }
+            if (hi - lo > widest) {
+                widest = hi - lo;
+                axis = k;
+            }
+        }
+        unsigned int mid = begin + (end - begin) / 2;
+        std::nth_element(keys.begin() + begin, keys.begin() + mid, keys.begin() + end,
+            [axis](const SplitKey& a, const SplitKey& b) { return a.key[axis] < b.key[axis]; });
+        splitMeshlets(keys, begin, mid, maxTris);
+        splitMeshlets(keys, mid, end, maxTris);
+    }
+
+    // Bounding sphere and normal cone of a meshlet's triangles
+    void setBounds(Meshlet& m) {
+        unsigned int first = m.firstTri, n = m.triCount;
+
+        //sphere around the centre of the bounding box
+        float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+        for (unsigned int i = first; i < first + n; i++)
+            for (unsigned int j = 0; j < 3; j++)
+                for (unsigned int k = 0; k < 3; k++) {
+                    lo[k] = std::min(lo[k], vertices[triangles[i].v[j]].p[k]);
+                    hi[k] = std::max(hi[k], vertices[triangles[i].v[j]].p[k]);
+                }
+        m.centre = vec4((lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f);
+        for (unsigned int i = first; i < first + n; i++)
+            for (unsigned int j = 0; j < 3; j++) {
+                vec4 d = vertices[triangles[i].v[j]].p - m.centre;
+                m.radius = std::max(m.radius, std::sqrt(vec4::dot(d, d)));
+            }
+
+        //cone around the front facing normals
+        //(slivers far below pixel size - e.g. at a sphere's poles - have meaningless normals and are left out)
+        float minArea = 1e-6f * m.radius * m.radius;
+        vec4 sum(0.f, 0.f, 0.f, 0.f);
+        for (unsigned int i = first; i < first + n; i++)
+            sum = sum + faceNormal(triangles[i], minArea);
+        float len = std::sqrt(vec4::dot(sum, sum));
+        if (len < 1e-6f) return;
+        m.coneAxis = sum * (1.f / len);
+        float minDot = 1.f;
+        for (unsigned int i = first; i < first + n; i++) {
+            vec4 f = faceNormal(triangles[i], minArea);
+            if (vec4::dot(f, f) > 0.f) minDot = std::min(minDot, vec4::dot(f, m.coneAxis));
+        }
+        if (minDot <= 0.f) return;
+        m.coneSin = std::sqrt(1.f - minDot * minDot);
+        m.hasCone = true;
+    }
+
+    // Unit front facing normal of a triangle (the side the rasterizer draws - the winding of every make* function)
+    // Input Variables:
+    // - t: Triangle
+    // - minArea: Triangles with less than this area (twice the area, object space) get a zero normal
+    vec4 faceNormal(const triIndices& t, float minArea = 0.f) const {
+        const vec4& p0 = vertices[t.v[0]].p;
+        vec4 n = vec4::cross(vertices[t.v[2]].p - p0, vertices[t.v[1]].p - p0);
+        float len = std::sqrt(vec4::dot(n, n));
+        return len > minArea ? n * (1.f / len) : vec4(0.f, 0.f, 0.f, 0.f);
+    }
 };
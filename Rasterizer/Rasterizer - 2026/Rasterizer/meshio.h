@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "vec4.h"
+#include "mesh.h"
+
+// A whole file mapped into memory. The mapping is copy-on-write: the pages are shared with the
+// file cache until something writes to them, and writes stay private to the process.
+class MappedFile {
+public:
+    // Map a file
+    // Returns nullptr if the file could not be opened or mapped (or is empty).
+    static std::shared_ptr<MappedFile> open(const std::string& filename) {
+        std::shared_ptr<MappedFile> f(new MappedFile());
+#if defined(_WIN32)
+        f->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (f->file == INVALID_HANDLE_VALUE) return nullptr;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(f->file, &size) || size.QuadPart == 0) return nullptr;
+        f->bytes = (size_t)size.QuadPart;
+        f->mapping = CreateFileMappingA(f->file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (!f->mapping) return nullptr;
+        f->base = static_cast<unsigned char*>(MapViewOfFile(f->mapping, FILE_MAP_COPY, 0, 0, 0));
+        if (!f->base) return nullptr;
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        f->bytes = (size_t)st.st_size;
+        void* p = mmap(nullptr, f->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) return nullptr;
+        f->base = static_cast<unsigned char*>(p);
+#endif
+        return f;
+    }
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (base) munmap(base, bytes);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    unsigned char* data() const {
+        return base;
+    }
+
+    size_t size() const {
+        return bytes;
+    }
+
+private:
+    MappedFile() = default;
+
+    unsigned char* base = nullptr;
+    size_t bytes = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// Header of a binary mesh file (.mesh). The file is the header followed by the mesh's arrays exactly
+// as they are laid out in memory - vertex records, triangle index buffer and meshlets (already built,
+// triangles in meshlet order) - each starting on a 64 byte boundary. Loading maps the file and points
+// the Mesh at the arrays, so nothing is parsed or copied; pages are read in as the renderer touches them.
+// Files are only read back by a build with the same record layouts (the sizes below are checked).
+struct alignas(64) MeshFileHeader {
+    static constexpr uint32_t magicValue = 0x4853454d; // "MESH"
+    static constexpr uint32_t currentVersion = 1;
+    static constexpr uint64_t streamAlignment = 64;
+
+    uint32_t magic = magicValue;
+    uint32_t version = currentVersion;
+    uint32_t vertexSize = sizeof(Vertex);
+    uint32_t triangleSize = sizeof(triIndices);
+    uint32_t meshletSize = sizeof(Meshlet);
+    uint32_t shading = 0;           // ShadingModel
+    float col[3] = { 1.f, 1.f, 1.f };
+    float ka = 0.75f, kd = 0.75f;
+    float boundSphereRad = 0.f;
+    uint64_t vertexCount = 0, vertexOffset = 0;     // offsets are in bytes from the start of the file
+    uint64_t triangleCount = 0, triangleOffset = 0;
+    uint64_t meshletCount = 0, meshletOffset = 0;
+};
+
+static_assert(sizeof(MeshFileHeader) == 128, "mesh file header layout changed");
+
+// Mesh import and export: Wavefront OBJ for interchange, the binary .mesh format for fast loading
+class MeshIO {
+public:
+    // Import a Wavefront OBJ file (v, vt, vn and f lines, other lines are ignored). Polygons are split
+    // into fans, corners sharing the same position / uv / normal indices become one vertex, and vertices
+    // without a normal get the area weighted average of their faces' normals. Vertices take the mesh
+    // colour, so call setColour first for anything but white. Meshlets are built.
+    // Input Variables:
+    // - filename: OBJ file
+    // Output Variables:
+    // - mesh: Replaced by the file's geometry
+    // Returns false if the file could not be read, has a face with a malformed corner or an index
+    // outside the lists, or has no faces.
+    static bool loadOBJ(const std::string& filename, Mesh& mesh) {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in) return false;
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        std::vector<float> positions, uvs, normals; //3, 2, 3 floats per entry
+        std::unordered_map<Corner, unsigned int, CornerHash> corners;
+        std::vector<Corner> face;
+        std::vector<bool> hasNormal;
+        mesh.vertices.clear();
+        mesh.triangles.clear();
+        mesh.meshlets.clear();
+
+        const char* p = text.c_str();
+        const char* end = p + text.size();
+        while (p < end) {
+            const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            while (p < eol && (*p == ' ' || *p == '\t')) p++;
+
+            if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+                readFloats(p + 2, 3, positions);
+            }
+            else if (p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+                readFloats(p + 3, 2, uvs);
+            }
+            else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+                readFloats(p + 3, 3, normals);
+            }
+            else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+                face.clear();
+                const char* q = p + 2;
+                while (true) {
+                    Corner c;
+                    CornerRead r = readCorner(q, eol, positions.size() / 3, uvs.size() / 2, normals.size() / 3, c);
+                    if (r == CornerRead::EndOfLine) break;
+                    if (r == CornerRead::Bad) return false;
+                    face.push_back(c);
+                }
+                if (face.size() < 3) return false;
+
+                unsigned int index[3] = { 0, 0, 0 };
+                for (size_t i = 0; i < face.size(); i++) {
+                    auto it = corners.find(face[i]);
+                    unsigned int v;
+                    if (it != corners.end()) v = it->second;
+                    else {
+                        v = (unsigned int)mesh.vertices.size();
+                        corners.emplace(face[i], v);
+                        const Corner& c = face[i];
+                        const float* pos = &positions[c.p * 3];
+                        vec4 n(0.f, 0.f, 0.f, 0.f);
+                        if (c.n >= 0) n = vec4(normals[c.n * 3], normals[c.n * 3 + 1], normals[c.n * 3 + 2], 0.f);
+                        //obj v runs up the image, texture v runs down it
+                        float u = c.t >= 0 ? uvs[c.t * 2] : 0.f;
+                        float w = c.t >= 0 ? 1.f - uvs[c.t * 2 + 1] : 0.f;
+                        mesh.addVertex(vec4(pos[0], pos[1], pos[2]), n, u, w);
+                        hasNormal.push_back(c.n >= 0);
+                    }
+                    //fan (0, i - 1, i) - obj faces are counter-clockwise, the mesh's are clockwise
+                    if (i == 0) index[0] = v;
+                    else if (i == 1) index[2] = v;
+                    else {
+                        index[1] = v;
+                        mesh.addTriangle(index[0], index[1], index[2]);
+                        index[2] = v;
+                    }
+                }
+            }
+            p = eol + 1;
+        }
+        if (mesh.triangles.empty()) return false;
+
+        //normals the file did not give
+        if (std::find(hasNormal.begin(), hasNormal.end(), false) != hasNormal.end()) {
+            for (const triIndices& t : mesh.triangles) {
+                const vec4& a = mesh.vertices[t.v[0]].p;
+                vec4 n = vec4::cross(mesh.vertices[t.v[2]].p - a, mesh.vertices[t.v[1]].p - a); //length = twice the area
+                n[3] = 0.f;
+                for (unsigned int k = 0; k < 3; k++)
+                    if (!hasNormal[t.v[k]]) mesh.vertices[t.v[k]].normal = mesh.vertices[t.v[k]].normal + n;
+            }
+            for (size_t i = 0; i < mesh.vertices.size(); i++)
+                if (!hasNormal[i]) mesh.vertices[i].normal.normalise();
+        }
+
+        mesh.calculateSphereRad();
+        mesh.buildMeshlets();
+        return true;
+    }
+
+    // Write a mesh as a binary .mesh file (see MeshFileHeader). Meshlets are built on a copy if the
+    // mesh has none. Texture and world matrix are not stored.
+    // Returns false if the file could not be written.
+    static bool saveBinary(const Mesh& mesh, const std::string& filename) {
+        if (mesh.meshlets.empty() && !mesh.triangles.empty()) {
+            Mesh built = mesh;
+            built.buildMeshlets();
+            return saveBinary(built, filename);
+        }
+
+        MeshFileHeader h;
+        h.shading = (uint32_t)mesh.shading;
+        h.col[0] = mesh.col[colour::RED];
+        h.col[1] = mesh.col[colour::GREEN];
+        h.col[2] = mesh.col[colour::BLUE];
+        h.ka = mesh.ka;
+        h.kd = mesh.kd;
+        h.boundSphereRad = mesh.boundSphereRad;
+        h.vertexCount = mesh.vertices.size();
+        h.triangleCount = mesh.triangles.size();
+        h.meshletCount = mesh.meshlets.size();
+        h.vertexOffset = align(sizeof(MeshFileHeader));
+        h.triangleOffset = align(h.vertexOffset + h.vertexCount * sizeof(Vertex));
+        h.meshletOffset = align(h.triangleOffset + h.triangleCount * sizeof(triIndices));
+
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        uint64_t written = 0;
+        auto put = [&](const void* data, uint64_t offset, uint64_t bytes) {
+            static const char zeros[MeshFileHeader::streamAlignment] = {};
+            out.write(zeros, (std::streamsize)(offset - written)); //padding up to the stream
+            out.write(static_cast<const char*>(data), (std::streamsize)bytes);
+            written = offset + bytes;
+        };
+        put(&h, 0, sizeof(h));
+        put(mesh.vertices.data(), h.vertexOffset, h.vertexCount * sizeof(Vertex));
+        put(mesh.triangles.data(), h.triangleOffset, h.triangleCount * sizeof(triIndices));
+        put(mesh.meshlets.data(), h.meshletOffset, h.meshletCount * sizeof(Meshlet));
+        return (bool)out;
+    }
+
+    // Load a binary .mesh file by mapping it: the mesh's vertices, triangles and meshlets become views
+    // of the mapping (which stays alive until no mesh uses it). Texture and world matrix are left as they were.
+    // Input Variables:
+    // - filename: .mesh file
+    // Output Variables:
+    // - mesh: Geometry, colour, reflection coefficients and shading model of the file
+    // Returns false if the file could not be mapped, is not a mesh file of this build's layout, or has a
+    // triangle index, meshlet range or shading model out of range (the index pass reads the triangle stream once).
+    static bool loadBinary(const std::string& filename, Mesh& mesh) {
+        std::shared_ptr<MappedFile> file = MappedFile::open(filename);
+        if (!file || file->size() < sizeof(MeshFileHeader)) return false;
+
+        MeshFileHeader h;
+        std::memcpy(&h, file->data(), sizeof(h));
+        if (h.magic != MeshFileHeader::magicValue || h.version != MeshFileHeader::currentVersion ||
+            h.vertexSize != sizeof(Vertex) || h.triangleSize != sizeof(triIndices) || h.meshletSize != sizeof(Meshlet))
+            return false;
+        if (!fits(h.vertexOffset, h.vertexCount, sizeof(Vertex), file->size()) ||
+            !fits(h.triangleOffset, h.triangleCount, sizeof(triIndices), file->size()) ||
+            !fits(h.meshletOffset, h.meshletCount, sizeof(Meshlet), file->size()))
+            return false;
+        if (h.shading > (uint32_t)ShadingModel::Textured) return false;
+
+        unsigned char* base = file->data();
+        const triIndices* tris = reinterpret_cast<const triIndices*>(base + h.triangleOffset);
+        const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(base + h.meshletOffset);
+        if (!validIndices(tris, h.triangleCount, h.vertexCount)) return false;
+        for (uint64_t i = 0; i < h.meshletCount; i++)
+            if ((uint64_t)meshlets[i].firstTri + meshlets[i].triCount > h.triangleCount) return false;
+
+        mesh.vertices.view(reinterpret_cast<Vertex*>(base + h.vertexOffset), (size_t)h.vertexCount, file);
+        mesh.triangles.view(reinterpret_cast<triIndices*>(base + h.triangleOffset), (size_t)h.triangleCount, file);
+        mesh.meshlets.view(reinterpret_cast<Meshlet*>(base + h.meshletOffset), (size_t)h.meshletCount, file);
+        mesh.col.set(h.col[0], h.col[1], h.col[2]);
+        mesh.ka = h.ka;
+        mesh.kd = h.kd;
+        mesh.shading = (ShadingModel)h.shading;
+        mesh.boundSphereRad = h.boundSphereRad;
+        return true;
+    }
+
+    // Load either format, picked by extension (.obj, anything else is taken as a .mesh file)
+    static bool load(const std::string& filename, Mesh& mesh) {
+        size_t dot = filename.find_last_of('.');
+        std::string ext = dot == std::string::npos ? "" : filename.substr(dot + 1);
+        for (char& c : ext) c = (char)std::tolower((unsigned char)c);
+        return ext == "obj" ? loadOBJ(filename, mesh) : loadBinary(filename, mesh);
+    }
+
+private:
+    // Position / uv / normal index of a face corner (0 based, -1 = none)
+    struct Corner {
+        long long p = -1, t = -1, n = -1;
+
+        bool operator == (const Corner& o) const {
+            return p == o.p && t == o.t && n == o.n;
+        }
+    };
+
+    struct CornerHash {
+        size_t operator () (const Corner& c) const {
+            uint64_t h = (uint64_t)c.p * 0x9E3779B97F4A7C15ull;
+            h ^= (uint64_t)(c.t + 1) * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+            h ^= (uint64_t)(c.n + 1) * 0x165667B19E3779F9ull + (h >> 32);
+            return (size_t)h;
+        }
+    };
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + MeshFileHeader::streamAlignment - 1) & ~(MeshFileHeader::streamAlignment - 1);
+    }
+
+    // True if count records of size bytes at offset lie inside the file (and the stream is aligned)
+    static bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize) {
+        if (offset % MeshFileHeader::streamAlignment != 0 || offset > fileSize) return false;
+        return count <= (fileSize - offset) / size;
+    }
+
+    // True if every index of the count triangles is below vertexCount
+    static bool validIndices(const triIndices* tris, uint64_t count, uint64_t vertexCount) {
+        unsigned int highest = 0;
+        for (uint64_t i = 0; i < count; i++)
+            highest = std::max({ highest, tris[i].v[0], tris[i].v[1], tris[i].v[2] });
+        return count == 0 || highest < vertexCount;
+    }
+
+    // Append count floats read from text (missing ones are 0)
+    static void readFloats(const char* s, int count, std::vector<float>& out) {
+        for (int i = 0; i < count; i++) {
+            char* next;
+            float f = std::strtof(s, &next);
+            out.push_back(f);
+            s = next;
+        }
+    }
+
+    // Result of reading one face corner
+    enum class CornerRead { Read, EndOfLine, Bad };
+
+    // Read one "p", "p/t", "p//n" or "p/t/n" corner (1 based, negative = relative to the end of the list)
+    // Returns EndOfLine when only white space is left, Bad for anything that is not a corner or has an
+    // index outside the lists.
+    static CornerRead readCorner(const char*& s, const char* eol, size_t positions, size_t uvs, size_t normals, Corner& c) {
+        while (s < eol && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+        if (s >= eol) return CornerRead::EndOfLine;
+        long long idx[3] = { 0, 0, 0 };
+        for (int k = 0; k < 3; k++) {
+            char* next;
+            idx[k] = std::strtoll(s, &next, 10);
+            if (k == 0 && next == s) return CornerRead::Bad; //the position index is required
+            s = next;
+            if (s >= eol || *s != '/') break;
+            s++;
+        }
+        if (s < eol && *s != ' ' && *s != '\t' && *s != '\r') return CornerRead::Bad; //junk after the corner
+
+        size_t sizes[3] = { positions, uvs, normals };
+        long long* out[3] = { &c.p, &c.t, &c.n };
+        for (int k = 0; k < 3; k++) {
+            if (idx[k] == 0) {
+                if (k == 0) return CornerRead::Bad;
+                continue;
+            }
+            long long i = idx[k] > 0 ? idx[k] - 1 : (long long)sizes[k] + idx[k];
+            if (i < 0 || i >= (long long)sizes[k]) return CornerRead::Bad;
+            *out[k] = i;
+        }
+        return CornerRead::Read;
+    }
+};
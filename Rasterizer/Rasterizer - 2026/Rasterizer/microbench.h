@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+// Micro benchmark harness - one kernel in isolation, away from whole frame noise.
+// The body runs warmUp times untimed, then reps times, each timed with the time stamp counter and
+// the steady clock. The median and best repetition are reported per element (TSC ticks run at the
+// CPU's nominal clock, so cycles are nominal cycles - compare runs on the same machine).
+class MicroBench {
+public:
+    int warmUp = 5;
+    int reps = 51;
+
+    // Time body() and print one result line
+    // Input Variables:
+    // - name: Kernel name
+    // - elements: Work items per call of body (matrices, pixels ...)
+    // - body: Kernel call
+    template <typename Body>
+    void run(const char* name, size_t elements, Body&& body) {
+        for (int i = 0; i < warmUp; i++) body();
+
+        std::vector<double> cycles(reps), ns(reps);
+        for (int i = 0; i < reps; i++) {
+            auto t0 = std::chrono::steady_clock::now();
+            unsigned long long c0 = __rdtsc();
+            body();
+            unsigned long long c1 = __rdtsc();
+            auto t1 = std::chrono::steady_clock::now();
+            cycles[i] = (double)(c1 - c0) / elements;
+            ns[i] = std::chrono::duration<double, std::nano>(t1 - t0).count() / elements;
+        }
+        std::sort(cycles.begin(), cycles.end());
+        std::sort(ns.begin(), ns.end());
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-28s %10zu %12.2f %12.2f %12.3f\n", name, elements, cycles[reps / 2], cycles[0], ns[reps / 2]);
+        std::cout << line;
+    }
+
+    // Column headings for run()
+    static void header() {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-28s %10s %12s %12s %12s\n", "kernel", "elements", "cyc/elem", "best", "ns/elem");
+        std::cout << line;
+    }
+
+    // Stop the compiler from removing work whose result is otherwise unused
+    template <typename T>
+    static void keep(const T& value) {
+#if defined(_MSC_VER)
+        //the address escapes and the barrier stops the compiler moving or dropping the stores to value
+        static const void* volatile escape;
+        escape = &value;
+        _ReadWriteBarrier();
+#else
+        //empty asm that claims to read value (and any memory), so value has to be computed
+        asm volatile("" : : "m"(value) : "memory");
+#endif
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Frame profiler - scoped zones recorded into per thread buffers, written out as Chrome trace JSON
+// (open in chrome://tracing or ui.perfetto.dev).
+// Each thread appends to its own fixed size buffer (single writer, the event count is published with
+// a release store), so recording takes no locks - the mutex is only taken the first time a thread
+// records, to register its buffer. Nothing is recorded (and nothing allocated) until begin() is called.
+// Zones are compiled out completely with PROFILER_ENABLED 0.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+class Profiler {
+public:
+    static constexpr size_t bufferEvents = 1 << 16; //events per thread per capture (more are dropped)
+
+    // One finished zone
+    struct Event {
+        const char* name;   // string literal (only the pointer is stored)
+        long long start;    // ns since the profiler was created
+        long long end;
+        unsigned int items; // work done in the zone (tiles, triangles ...), 0 = none
+        bool work;          // counts as busy time for the thread summary
+    };
+
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    bool recording() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    // Start a capture (clears the previous one). Call between frames - no zone may be open.
+    void begin() {
+        std::lock_guard<std::mutex> lock(registry);
+        for (auto& b : buffers) {
+            b->count.store(0);
+            b->dropped = 0;
+        }
+        captureStart = now();
+        captureEnd = captureStart;
+        active.store(true);
+    }
+
+    // Stop recording (events stay until the next begin)
+    void end() {
+        active.store(false);
+        captureEnd = now();
+    }
+
+    // Name the calling thread in the trace (kept until the thread first records)
+    void nameThread(const std::string& name) {
+        localName() = name;
+        if (localBuffer()) localBuffer()->name = name;
+    }
+
+    // Add a finished zone to the calling thread's buffer
+    void record(const char* name, long long start, long long end, unsigned int items, bool work) {
+        Buffer& b = threadBuffer();
+        size_t n = b.count.load(std::memory_order_relaxed);
+        if (n == bufferEvents) {
+            b.dropped++;
+            return;
+        }
+        b.events[n] = { name, start, end, items, work };
+        b.count.store(n + 1, std::memory_order_release);
+    }
+
+    // Time in ns since the profiler was created
+    long long now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    // Write the last capture as Chrome trace events (complete "X" events, times in microseconds)
+    // Input Variables:
+    // - filename: Output .json path
+    // Returns false if the file could not be written.
+    bool writeChromeTrace(const std::string& filename) {
+        std::ofstream out(filename);
+        if (!out) return false;
+        std::lock_guard<std::mutex> lock(registry);
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (size_t t = 0; t < buffers.size(); t++) {
+            const Buffer& b = *buffers[t];
+            size_t n = b.count.load(std::memory_order_acquire);
+            if (n == 0) continue;
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << t
+                << ",\"args\":{\"name\":\"" << (b.name.empty() ? "thread " + std::to_string(t) : b.name) << "\"}}";
+            first = false;
+            for (size_t i = 0; i < n; i++) {
+                const Event& e = b.events[i];
+                out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t
+                    << ",\"ts\":" << (e.start - captureStart) / 1000.0 << ",\"dur\":" << (e.end - e.start) / 1000.0;
+                if (e.items) out << ",\"args\":{\"items\":" << e.items << "}";
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+        return (bool)out;
+    }
+
+    // Print busy / idle time and items processed per thread for the last capture
+    // (busy = time inside work zones, idle = the rest of the capture)
+    void printSummary() {
+        std::lock_guard<std::mutex> lock(registry);
+        double span = (captureEnd - captureStart) / 1e6;
+        std::cout << "profile " << span << " ms\n";
+        for (size_t t = 0; t < buffers.size(); t++) {
+            const Buffer& b = *buffers[t];
+            size_t n = b.count.load(std::memory_order_acquire);
+            if (n == 0) continue;
+            double busy = 0.0;
+            unsigned long long items = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (!b.events[i].work) continue;
+                busy += (b.events[i].end - b.events[i].start) / 1e6;
+                items += b.events[i].items;
+            }
+            std::cout << "  " << (b.name.empty() ? "thread " + std::to_string(t) : b.name) << ": busy " << busy << " ms, idle "
+                << std::max(span - busy, 0.0) << " ms, items " << items;
+            if (b.dropped) std::cout << " (" << b.dropped << " events dropped)";
+            std::cout << "\n";
+        }
+    }
+
+private:
+    struct Buffer {
+        std::unique_ptr<Event[]> events{ new Event[bufferEvents] };
+        std::atomic<size_t> count{ 0 };
+        size_t dropped = 0;
+        std::string name;
+    };
+
+    std::vector<std::unique_ptr<Buffer>> buffers; //every thread that has recorded (never shrinks)
+    std::mutex registry;
+    std::atomic<bool> active{ false };
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    long long captureStart = 0, captureEnd = 0;
+
+    static Buffer*& localBuffer() {
+        thread_local Buffer* buffer = nullptr;
+        return buffer;
+    }
+
+    static std::string& localName() {
+        thread_local std::string name;
+        return name;
+    }
+
+    // Calling thread's buffer, registered on first use
+    Buffer& threadBuffer() {
+        Buffer*& buffer = localBuffer();
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(registry);
+            buffers.push_back(std::make_unique<Buffer>());
+            buffer = buffers.back().get();
+            buffer->name = localName();
+        }
+        return *buffer;
+    }
+};
+
+// Records the time between construction and destruction (only while a capture is running)
+class ProfileZone {
+public:
+    unsigned int items = 0; //set inside the zone to report work done
+
+    ProfileZone(const char* _name, bool _work = false) : name(_name), work(_work) {
+        if (Profiler::instance().recording()) start = Profiler::instance().now();
+    }
+
+    ~ProfileZone() {
+        if (start >= 0 && Profiler::instance().recording())
+            Profiler::instance().record(name, start, Profiler::instance().now(), items, work);
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    bool work;
+    long long start = -1;
+};
+
+#if PROFILER_ENABLED
+#define PROFILER_CONCAT2(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
+// Zone covering the rest of the enclosing scope
+#define PROFILE_ZONE(name) ProfileZone PROFILER_CONCAT(profileZone, __LINE__)(name)
+// Named zone counted as busy time, items reported with PROFILE_ITEMS(var, n)
+#define PROFILE_WORK(var, name) ProfileZone var(name, true)
+#define PROFILE_ITEMS(var, n) (var.items += (unsigned int)(n))
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_WORK(var, name) ((void)0)
+#define PROFILE_ITEMS(var, n) ((void)0)
+#endif
@@ -22,35 +22,65 @@
 #include "RNG.h"
 #include "light.h"
 #include "triangle.h"
+#include "texture.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "stats.h"
+#include "bench.h"
+#include "microbench.h"
+#include "dispatch.h"
+#include "transform.h"
+#include "scene.h"
+#include "meshio.h"
+#include "streaming.h"
 
 class ThreadSys {
 public:
     //pointers (to read thread data)
     Renderer* currentRenderer = nullptr;
-    matrix* currentCamera = nullptr;
     Light* currentLight = nullptr;
     std::vector<Mesh*>* currentScene = nullptr;
+    //lights for the frame in view space (sun normalised once, local lights prepared once)
+    ShadeContext frameShade;
+    std::vector<LightView> frameLights;
+
+    //work stealing scheduler - every stage of the frame (clear, geom, merge, binning, raster) is a parallelFor on it
+    Scheduler scheduler;
+
+    //object to view (mv) and to clip space (mvp) of every mesh, worked out once per frame in setup
+    //(not per meshlet) and kept across frames - only recomputed when the mesh's world matrix, the
+    //camera or the projection changes
+    struct MeshTransform {
+        const Mesh* mesh = nullptr;
+        matrix world;   //world matrix mv and mvp were made from
+        matrix mv;
+        matrix mvp;
+    };
+    std::vector<MeshTransform> meshTransforms;
+    matrix viewCamera, viewProjection; //camera and projection the cache was made with
+    size_t transformsUpdated = 0;
 
-    //thread m
-    std::vector<std::thread> threadPool;
-    //make threads exit infinite loop
-    std::atomic<bool> stop{ false };
-
-    //used to see when thread tasks are complete
-    std::atomic<int> threadTaskCount{ 0 };
-    //start loop
-    std::atomic<int> start{ 0 };
-
-    //see what geom work next (atomic because two threads can catch)
-    std::atomic<size_t> geomCount{ 0 };
-    std::atomic<size_t> pTileCount{ 0 };
-
-    //pipleline state - swap between geom/raster
-    enum class PipelineState { geomState, rasterizeState };
-    std::atomic<PipelineState> currentState{ PipelineState::geomState };
+    //geometry work - one item per meshlet, so one big mesh spreads across workers
+    struct GeomWork {
+        Mesh* mesh;
+        const Meshlet* meshlet;
+        const MeshTransform* transform;
+    };
+    std::vector<GeomWork> geomWork;
+    //view frustum planes in view space (x, y, z, d - inside when dot + d >= 0), for meshlet culling
+    vec4 frustum[6];
+    //where each work item left its triangles (worker cache, offset, count) and where they go in triControl
+    //merged in work order, so draw order does not depend on which worker ran what
+    struct GeomSpan {
+        unsigned int worker, offset, count, dest;
+    };
+    std::vector<GeomSpan> geomSpans;
 
-    //tile (screen)
+    //tile (screen) - bins used for scheduling and light culling, rasterized in 8x8 micro tiles (HiZ::size)
+    //tileSize is picked by tuneBins from binSizes unless fixedBinSize is set
     int tileSize = 32;
+    static constexpr int binSizes[3] = { 32, 64, 128 };
+    int fixedBinSize = 0;
     int gridW = 0;
     int gridH = 0;
 
@@ -61,9 +91,10 @@ public:
     //triangle struct (geom)
     struct mainTri {
         Vertex v[3];
-        float ka;
-        float kd;
+        Material mat;
+        ShadingModel shading;
         int minX, maxX, minY, maxY;
+        bool micro; //covers at most 2x2 pixels - batched fast path
     };
 
     //buffer
@@ -71,154 +102,454 @@ public:
     std::vector<mainTri> triControl;
 
     std::vector<std::vector<mainTri>> threadGeomCache;
-    std::vector<std::vector<int>> tileTList;
+    //tile bins - one flat index buffer, tile i owns binIndices[binOffset[i] .. binOffset[i + 1])
+    //all three keep their capacity between frames, so binning stops allocating once the scene is warm
+    std::vector<unsigned int> binIndices;
+    std::vector<unsigned int> binOffset;
+    std::vector<unsigned int> binCursor;
+    //depth range of the triangles in each tile (ndc z) - used for light culling
+    std::vector<float> tileMinZ;
+    std::vector<float> tileMaxZ;
+    //per thread culled light list (reused every tile)
+    std::vector<std::vector<unsigned int>> threadTileLights;
+    //per thread multisample tile (only used when the renderer has 4 samples)
+    std::vector<SampleTile> threadSampleTiles;
+    //farthest depth per 8x8 micro tile (reset every frame)
+    HiZ hiz;
+
+    //raster work list - one task per bin (or per strip of a heavy bin), most expensive first
+    //so the slow tiles start early instead of being the last thing left at the barrier
+    struct RasterTask {
+        int tileID;
+        int yStart, yEnd; //rows of the bin this task covers
+        float cost;
+    };
+    std::vector<RasterTask> rasterTasks;
+    std::vector<RasterTask> rasterSorted; //scratch for dealing the sorted tasks to the workers
+    std::vector<float> binCost;
+    //cost estimate weights - setup per triangle, per pixel of its bounding box inside the bin
+    //(a triangle covers about half its box)
+    static constexpr float triCost = 24.f;
+    static constexpr float pixelCost = 0.5f;
+    //time each thread finished rasterizing, idle time at the raster barrier summed until reportIdle (ms)
+    std::vector<std::chrono::high_resolution_clock::time_point> threadRasterEnd;
+    std::vector<double> threadIdle;
+    int idleFrames = 0;
+
+    //bin size calibration - each candidate runs tuneFrames frames (the first is warm up and not timed),
+    //then the fastest is kept until the resolution or the triangle count changes a lot
+    static constexpr int tuneFrames = 4;
+    struct BinTuning {
+        int frame = 0;
+        double time[3] = {};
+        int width = 0, height = 0;
+        size_t triangles = 0;
+        bool done = false;
+    } tuning;
+
+    //how the scheduler uses the machine (see configure)
+    ThreadConfig threadConfig;
+
+    //trace capture - frames still to record (0 = none running) and where to write it
+    int captureFrames = 0;
+    std::string capturePath;
+
+    //pipeline statistics - every worker counts into its own ThreadStats, added up at the end of the frame
+    std::vector<ThreadStats> threadStats;
+    PipelineStats frameStats;   //last frame
+    PipelineStats statsTotal;   //summed until reportStats
+    int statsFrames = 0;
+
+    //debug view drawn over the frame - write count per pixel, or measured raster time per bin
+    enum class DebugView { None, Overdraw, TileCost };
+    DebugView debugView = DebugView::None;
+    std::vector<unsigned int> overdraw; //canvas sized, rows padded to 16
+    std::vector<double> taskTime;       //per raster task (ms)
+    std::vector<double> tileTime;       //per bin (ms)
 
     //main run call
-    void run(Renderer& r, std::vector<Mesh*>& meshes, matrix& cam, Light& light) {
+    //lights - optional point/spot lights (world space)
+    void run(Renderer& r, std::vector<Mesh*>& meshes, matrix& cam, Light& light, const std::vector<LocalLight>* lights = nullptr) {
         //pointers
         currentRenderer = &r;
-        currentCamera = &cam;
         currentLight = &light;
         currentScene = &meshes;
 
-        //call initialising threads first
-        initThreads();
+        updateCapture();
+        PROFILE_ZONE("frame");
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        {
+            PROFILE_ZONE("setup");
+            chooseBinSize(r);
+            setupLights(r, cam, light, lights);
+            setupFrustum(r.perspective);
+
+            //call initialising threads first
+            initThreads();
+
+            //canvas w and h
+            canvasW = (float)r.canvas.getWidth();
+            canvasH = (float)r.canvas.getHeight();
+            updateTransforms(r, meshes, cam);
+            buildGeomWork(meshes);
+        }
 
         //geom
-        //set state to geom first
-        currentState.store(PipelineState::geomState);
-        //reset to 0
-        geomCount.store(0);
-        threadTaskCount.store(0);
-        //start threads 
-        start.fetch_add(1);
-
-        syncThreads();
+        {
+            PROFILE_ZONE("geometry");
+            scheduler.parallelFor(geomWork.size(), 0, [this](size_t begin, size_t end, unsigned int worker) {
+                PROFILE_WORK(zone, "geometry chunk");
+                PROFILE_ITEMS(zone, end - begin);
+                for (size_t i = begin; i < end; ++i) executegeomState(worker, i);
+                });
+        }
 
         //merge thread buffer to one
-        mergeGeom();
+        {
+            PROFILE_ZONE("merge");
+            mergeGeom();
+        }
         //sort grid triangles
-        sortTriLists();
-
-        //rasterize
-        //drawing happens - set rasterize
-        currentState.store(PipelineState::rasterizeState);
-        //reset to 0
-        pTileCount.store(0);
-        threadTaskCount.store(0);
-        //start threads
-        start.fetch_add(1);
-
-        syncThreads();
-    }
-
-    void initThreads() {
-        //if nothing in pool return
-        if (!threadPool.empty()) return;
-
-        //thread count (hardware_concurreny for max threads)
-        int cores = std::thread::hardware_concurrency();
-
-        //resize so each thread owns
-        threadPool.resize(cores);
-        threadGeomCache.resize(cores);
-
-
-        for (int i = 0; i < cores; ++i) {
-            threadPool[i] = std::thread([this, i]() {
-                //startthread signal
-                int startThread = 0;
+        {
+            PROFILE_ZONE("bin");
+            sortTriLists();
+            buildRasterTasks();
+            hiz.create(r.canvas.getWidth(), r.canvas.getHeight());
+        }
 
-                while (true) {
-                    //wait until signal changed
-                    while (start.load() == startThread) {
-                        if (stop.load()) return;
-                        std::this_thread::yield();
+        //rasterize (a worker that gets no task has been idle since the start)
+        {
+            PROFILE_ZONE("raster");
+            setupDebugView(r);
+            std::fill(threadRasterEnd.begin(), threadRasterEnd.end(), std::chrono::high_resolution_clock::now());
+            scheduler.parallelFor(rasterTasks.size(), 1, [this](size_t begin, size_t end, unsigned int worker) {
+                PROFILE_WORK(zone, "raster tiles");
+                PROFILE_ITEMS(zone, end - begin);
+                for (size_t i = begin; i < end; ++i) {
+                    if (debugView == DebugView::TileCost) {
+                        auto taskStart = std::chrono::high_resolution_clock::now();
+                        executerasterizeState(worker, rasterTasks[i]);
+                        taskTime[i] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - taskStart).count();
                     }
+                    else executerasterizeState(worker, rasterTasks[i]);
+                }
+                threadRasterEnd[worker] = std::chrono::high_resolution_clock::now();
+                });
+            recordIdle();
+        }
+        collectStats();
+        if (debugView != DebugView::None) drawDebugView(r);
 
-                    //if signal changed then update
-                    startThread = start.load();
+        tuneBins(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count());
+    }
 
-                    //check the state and run (if state is geom then run the geometry)
-                    if (currentState.load() == PipelineState::geomState)
-                        //vertices
-                        executegeomState(i);
-                    else
-                        //rasterize
-                        executerasterizeState(i);
+    //start / finish a capture requested with captureTrace (frame boundary = start of run)
+    void updateCapture() {
+        if (captureFrames == 0) return;
+        Profiler& profiler = Profiler::instance();
+        if (!profiler.recording()) {
+            profiler.begin();
+            return;
+        }
+        if (--captureFrames > 0) return;
+        profiler.end();
+        if (profiler.writeChromeTrace(capturePath)) std::cout << "trace written to " << capturePath << "\n";
+        profiler.printSummary();
+    }
 
-                    //add to finish
-                    threadTaskCount.fetch_add(1);
-                }
-                });
+    //bin size for this frame (calibration candidate, tuned size or fixed size)
+    void chooseBinSize(Renderer& r) {
+        if (fixedBinSize > 0) {
+            tileSize = fixedBinSize;
+            return;
+        }
+        int w = r.canvas.getWidth(), h = r.canvas.getHeight();
+        if (w != tuning.width || h != tuning.height) {
+            tuning = BinTuning();
+            tuning.width = w;
+            tuning.height = h;
         }
+        if (!tuning.done) tileSize = binSizes[tuning.frame / tuneFrames];
     }
 
-    void syncThreads() {
-        while (threadTaskCount.load() < threadPool.size())
-            std::this_thread::yield();
+    //record the frame time for calibration, pick the fastest bin size at the end
+    //(sizes that leave fewer than two bins per thread are skipped - too coarse to balance)
+    void tuneBins(double ms) {
+        if (fixedBinSize > 0) return;
+        if (tuning.done) {
+            //scene changed a lot since tuning - calibrate again
+            if (triControl.size() > tuning.triangles * 2 || triControl.size() * 2 < tuning.triangles) {
+                int w = tuning.width, h = tuning.height;
+                tuning = BinTuning();
+                tuning.width = w;
+                tuning.height = h;
+            }
+            return;
+        }
+        if (tuning.frame % tuneFrames != 0) tuning.time[tuning.frame / tuneFrames] += ms;
+        tuning.frame++;
+        if (tuning.frame < 3 * tuneFrames) return;
+
+        int best = 0;
+        size_t minBins = scheduler.workerCount() * 2;
+        for (int i = 0; i < 3; i++) {
+            size_t bins = (size_t)((tuning.width + binSizes[i] - 1) / binSizes[i]) * ((tuning.height + binSizes[i] - 1) / binSizes[i]);
+            if (i > 0 && bins < minBins) break;
+            if (tuning.time[i] < tuning.time[best]) best = i;
+        }
+        tileSize = binSizes[best];
+        tuning.triangles = triControl.size();
+        tuning.done = true;
     }
 
-    void executegeomState(int threadID) {
-        //pointers
-        Renderer& r = *currentRenderer;
-        matrix cam = *currentCamera;
+    void initThreads() {
+        //already running
+        if (!threadGeomCache.empty()) return;
+
+        //workers from the thread config (default - one per physical core, the calling thread is worker 0)
+        scheduler.start(threadConfig);
+        unsigned int workers = scheduler.workerCount();
+
+        //resize so each worker owns
+        threadGeomCache.resize(workers);
+        threadTileLights.resize(workers);
+        threadSampleTiles.resize(workers);
+        threadRasterEnd.resize(workers);
+        threadIdle.assign(workers, 0.0);
+        threadStats.resize(workers);
+    }
 
-        //canvas w and h
-        canvasW = (float)r.canvas.getWidth();
-        canvasH = (float)r.canvas.getHeight();
+    //change the worker count / pinning, the pool restarts on the next frame
+    //(bin size calibration starts again - the best size depends on the worker count)
+    void configure(const ThreadConfig& config) {
+        scheduler.stop();
+        threadConfig = config;
+        threadGeomCache.clear();
+        threadTileLights.clear();
+        threadSampleTiles.clear();
+        threadRasterEnd.clear();
+        threadIdle.clear();
+        threadStats.clear();
+        idleFrames = 0;
+        tuning = BinTuning();
+    }
 
-        auto& scene = *currentScene;
-        size_t totalMesh = scene.size();
+    //record a Chrome trace of the next frames and write it to path when they are done
+    //(ignored while a capture is already running)
+    void captureTrace(int frames, const std::string& path) {
+        if (captureFrames > 0) return;
+        captureFrames = std::max(frames, 1);
+        capturePath = path;
+    }
 
-        while (true) {
-            //get next mesh
-            size_t idx = geomCount.fetch_add(1);
+    //debug keys shared by the scenes: P records a trace of the next 60 frames, 0 / 1 / 2 pick the debug view
+    void handleDebugKeys(GamesEngineeringBase::Window& canvas) {
+        if (canvas.keyPressed('P')) captureTrace(60, "trace.json");
+        if (canvas.keyPressed('0')) debugView = DebugView::None;
+        if (canvas.keyPressed('1')) debugView = DebugView::Overdraw;
+        if (canvas.keyPressed('2')) debugView = DebugView::TileCost;
+    }
 
-            //if done (reach all mesh)
-            if (idx >= totalMesh) break;
+    //workers running the frame
+    unsigned int workerCount() const {
+        return scheduler.workerCount();
+    }
 
+    //clear the canvas and zbuffer in bands of rows across the workers
+    void clear(Renderer& r) {
+        PROFILE_ZONE("clear");
+        initThreads();
+        unsigned int h = r.canvas.getHeight();
+        constexpr unsigned int band = 16;
+        scheduler.parallelFor((h + band - 1) / band, 1, [&r, h](size_t begin, size_t end, unsigned int) {
+            PROFILE_WORK(zone, "clear rows");
+            r.clearRows((unsigned int)begin * band, std::min((unsigned int)end * band, h));
+            });
+    }
 
-            Mesh* mesh = scene[idx];
-            matrix mvp = r.perspective * cam * mesh->world;
+    //run scene update work on the pipeline's workers
+    //body(begin, end, worker) is called on chunks of [0, count)
+    template <typename Body>
+    void parallelFor(size_t count, Body&& body) {
+        initThreads();
+        scheduler.parallelFor(count, 0, body);
+    }
 
-            //triangle loop - check every tri in mesh
-            for (auto& face : mesh->triangles) {
-                mainTri tri;
-                tri.ka = mesh->ka;
-                tri.kd = mesh->kd;
-                bool skip = false;
+    //move lights into view space once per frame
+    void setupLights(Renderer& r, matrix& cam, Light& light, const std::vector<LocalLight>* lights) {
+        frameShade.sun = light;
+        frameShade.sun.omega_i = cam * light.omega_i;
+        frameShade.sun.omega_i.normalise();
+        frameShade.setProjection(r.perspective, (float)r.canvas.getWidth(), (float)r.canvas.getHeight());
+
+        frameLights.clear();
+        if (lights) {
+            for (auto& l : *lights)
+                frameLights.push_back(LightView::make(l, cam));
+        }
+        frameShade.lights = frameLights.data();
+        frameShade.allLightCount = (unsigned int)frameLights.size();
+        frameShade.tileLights = nullptr;
+        frameShade.tileLightCount = 0;
+    }
 
-                for (int k = 0; k < 3; ++k) {
-                    unsigned int vIdx = face.v[k];
+    //bring the per mesh matrices up to date (every one if the camera or projection moved)
+    void updateTransforms(Renderer& r, std::vector<Mesh*>& meshes, const matrix& cam) {
+        bool viewChanged = cam != viewCamera || r.perspective != viewProjection;
+        viewCamera = cam;
+        viewProjection = r.perspective;
+        meshTransforms.resize(meshes.size());
+        transformsUpdated = 0;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            MeshTransform& t = meshTransforms[i];
+            if (!viewChanged && t.mesh == meshes[i] && t.world == meshes[i]->world) continue;
+            t.mesh = meshes[i];
+            t.world = meshes[i]->world;
+            t.mv = cam * t.world;
+            t.mvp = r.perspective * t.mv;
+            transformsUpdated++;
+        }
+    }
 
-                    //transform
-                    tri.v[k].p = mvp * mesh->vertices[vIdx].p;
-                    tri.v[k].p.divideW();
+    //one geometry work item per meshlet (meshes not made by the make* functions are clustered on first use)
+    void buildGeomWork(std::vector<Mesh*>& meshes) {
+        geomWork.clear();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            Mesh* mesh = meshes[i];
+            if (mesh->meshlets.empty()) mesh->buildMeshlets();
+            for (const Meshlet& m : mesh->meshlets)
+                geomWork.push_back({ mesh, &m, &meshTransforms[i] });
+        }
+        geomSpans.resize(geomWork.size());
+    }
 
-                    //zclip
-                    if (fabs(tri.v[k].p[2]) > 1.0f) {
-                        skip = true;
-                        break;
-                    }
+    //frustum planes from the projection (rows of the matrix, Gribb/Hartmann), normalised
+    void setupFrustum(const matrix& proj) {
+        for (unsigned int i = 0; i < 6; i++) {
+            unsigned int row = i / 2;
+            float sign = (i & 1) ? -1.f : 1.f;
+            float p[4];
+            for (unsigned int k = 0; k < 4; k++) p[k] = proj(3, k) + sign * proj(row, k);
+            float len = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            frustum[i] = vec4(p[0] / len, p[1] / len, p[2] / len, p[3] / len);
+        }
+    }
 
-                    //viewport
-                    tri.v[k].p[0] = (tri.v[k].p[0] + 1.f) * 0.5f * canvasW;
-                    tri.v[k].p[1] = (tri.v[k].p[1] + 1.f) * 0.5f * canvasH;
-                    tri.v[k].p[1] = canvasH - tri.v[k].p[1];
+    //true if none of the meshlet can be drawn - outside a frustum plane, or every triangle faces away
+    //Input Variables:
+    // - m: Meshlet
+    // - mv: Object to view space (rotation, translation and uniform scale)
+    bool cullMeshlet(const Meshlet& m, const matrix& mv) {
+        vec4 c = mv * m.centre;
+        //radius in view space (largest axis scale)
+        float scale = 0.f;
+        for (unsigned int k = 0; k < 3; k++)
+            scale = std::max(scale, mv(0, k) * mv(0, k) + mv(1, k) * mv(1, k) + mv(2, k) * mv(2, k));
+        float r = m.radius * std::sqrt(scale);
+
+        for (unsigned int i = 0; i < 6; i++)
+            if (vec4::dot(frustum[i], c) + frustum[i][3] < -r) return true;
+
+        //backface cone - the eye is at the origin, so c is the direction from the eye to the sphere
+        //every triangle faces away if the angle from c to the axis, plus the angle the sphere covers,
+        //plus the cone's half angle is at most 90 degrees
+        if (!m.hasCone) return false;
+        float dist = std::sqrt(vec4::dot(c, c));
+        if (dist <= r) return false;
+        vec4 axis = mv * m.coneAxis;
+        axis.normalise();
+        float cosA = vec4::dot(c, axis) / dist;
+        float sinA = std::sqrt(std::max(1.f - cosA * cosA, 0.f));
+        float sinB = r / dist, cosB = std::sqrt(1.f - sinB * sinB);
+        return cosA * cosB - sinA * sinB >= m.coneSin;
+    }
 
-                    //colour/norm
-                    tri.v[k].normal = mesh->world * mesh->vertices[vIdx].normal;
-                    tri.v[k].normal.normalise();
-                    tri.v[k].rgb = mesh->vertices[vIdx].rgb;
+    void executegeomState(unsigned int threadID, size_t item) {
+        //pointers
+        const GeomWork& work = geomWork[item];
+        std::vector<mainTri>& cache = threadGeomCache[threadID];
+        GeomSpan& span = geomSpans[item];
+        span.worker = threadID;
+        span.offset = (unsigned int)cache.size();
+
+        Mesh* mesh = work.mesh;
+        const matrix& mv = work.transform->mv;
+        span.count = 0;
+        GeomStats& stats = threadStats[threadID].geom;
+        stats.meshlets++;
+        stats.triangles += work.meshlet->triCount;
+        //whole meshlet off screen or facing away - its vertices are never touched
+        if (cullMeshlet(*work.meshlet, mv)) {
+            stats.meshletsCulled++;
+            return;
+        }
+        const matrix& mvp = work.transform->mvp;
+
+        //triangle loop - check every tri in this meshlet
+        unsigned int last = work.meshlet->firstTri + work.meshlet->triCount;
+        for (unsigned int f = work.meshlet->firstTri; f < last; ++f) {
+            const auto& face = mesh->triangles[f];
+            mainTri tri;
+            tri.mat.ka = mesh->ka;
+            tri.mat.kd = mesh->kd;
+            tri.mat.texture = mesh->texture;
+            tri.shading = mesh->shading;
+            //textured mesh without a texture - light it like phong
+            if (tri.shading == ShadingModel::Textured && !tri.mat.texture) tri.shading = ShadingModel::Phong;
+            bool skip = false;
+
+            for (int k = 0; k < 3; ++k) {
+                unsigned int vIdx = face.v[k];
+
+                //transform
+                tri.v[k].p = mvp * mesh->vertices[vIdx].p;
+                //keep 1/w in p[3] for perspective correct texture coords
+                float w = tri.v[k].p[3];
+                tri.v[k].p.divideW();
+                tri.v[k].p[3] = 1.0f / w;
+
+                //zclip
+                if (fabs(tri.v[k].p[2]) > 1.0f) {
+                    skip = true;
+                    break;
                 }
 
-                if (skip) continue;
-                //calc where triangle should be
-                setBound(tri);
-                //write thread cache
-                threadGeomCache[threadID].push_back(tri);
+                //viewport
+                tri.v[k].p[0] = (tri.v[k].p[0] + 1.f) * 0.5f * canvasW;
+                tri.v[k].p[1] = (tri.v[k].p[1] + 1.f) * 0.5f * canvasH;
+                tri.v[k].p[1] = canvasH - tri.v[k].p[1];
+
+                //colour/norm (view space)
+                tri.v[k].normal = mv * mesh->vertices[vIdx].normal;
+                tri.v[k].normal.normalise();
+                tri.v[k].rgb = mesh->vertices[vIdx].rgb;
+                tri.v[k].uv[0] = mesh->vertices[vIdx].uv[0];
+                tri.v[k].uv[1] = mesh->vertices[vIdx].uv[1];
             }
+
+            if (skip) {
+                stats.clipped++;
+                continue;
+            }
+            //per vertex/triangle lighting (flat + gouraud)
+            shadeGeom(tri);
+            //calc where triangle should be
+            setBound(tri);
+            tri.micro = FixedEdges::isMicro(tri.v);
+            //write thread cache
+            cache.push_back(tri);
+        }
+        span.count = (unsigned int)cache.size() - span.offset;
+        stats.emitted += span.count;
+    }
+
+    void shadeGeom(mainTri& tri) {
+        switch (tri.shading) {
+        case ShadingModel::Unlit: UnlitShader::geometry(tri.v, frameShade, tri.mat); break;
+        case ShadingModel::Flat: FlatShader::geometry(tri.v, frameShade, tri.mat); break;
+        case ShadingModel::Gouraud: GouraudShader::geometry(tri.v, frameShade, tri.mat); break;
+        case ShadingModel::Phong: PhongShader::geometry(tri.v, frameShade, tri.mat); break;
+        case ShadingModel::Textured: TexturedShader::geometry(tri.v, frameShade, tri.mat); break;
         }
     }
 
@@ -228,6 +559,13 @@ public:
         tri.minY = std::min({ tri.v[0].p[1], tri.v[1].p[1], tri.v[2].p[1] });
         tri.maxY = std::max({ tri.v[0].p[1], tri.v[1].p[1], tri.v[2].p[1] });
 
+        //msaa samples sit up to 3/8 of a pixel from the pixel, so a triangle can cover samples of
+        //the pixel just right of / below its box (a pixel left of / above the box never gets one)
+        if (currentRenderer->samples > 1) {
+            tri.maxX++;
+            tri.maxY++;
+        }
+
         tri.minX = std::max(0, tri.minX);
         tri.minY = std::max(0, tri.minY);
         tri.maxX = std::min((int)canvasW - 1, tri.maxX);
@@ -235,11 +573,23 @@ public:
     }
 
     void mergeGeom() {
-        triControl.clear();
-        for (auto& buffer : threadGeomCache) {
-            triControl.insert(triControl.end(), buffer.begin(), buffer.end());
-            buffer.clear();
+        //where each work item's triangles go (scene order)
+        unsigned int total = 0;
+        for (auto& span : geomSpans) {
+            span.dest = total;
+            total += span.count;
         }
+        triControl.resize(total);
+
+        scheduler.parallelFor(geomSpans.size(), 0, [this](size_t begin, size_t end, unsigned int) {
+            PROFILE_WORK(zone, "merge copy");
+            for (size_t i = begin; i < end; ++i) {
+                const GeomSpan& span = geomSpans[i];
+                const mainTri* src = threadGeomCache[span.worker].data() + span.offset;
+                std::copy(src, src + span.count, triControl.begin() + span.dest);
+            }
+            });
+        for (auto& buffer : threadGeomCache) buffer.clear();
     }
 
     void sortTriLists() {
@@ -250,70 +600,341 @@ public:
         gridW = (w + tileSize - 1) / tileSize;
         gridH = (h + tileSize - 1) / tileSize;
 
-        tileTList.clear();
-        tileTList.resize(gridW * gridH);
+        int tileCount = gridW * gridH;
+        binOffset.assign(tileCount + 1, 0);
+        binCost.assign(tileCount, 0.f);
+        tileMinZ.assign(tileCount, 1.0f);
+        tileMaxZ.assign(tileCount, -1.0f);
+
+        //both passes run in bands of tile rows, one task per band - a band only touches its own bins,
+        //so no locks (every band reads all the triangles, hence only a couple of bands per worker)
+        unsigned int workers = scheduler.workerCount();
+        int bands = workers > 1 ? std::min(gridH, (int)workers * 2) : 1;
+
+        //pass 1 - count triangles per tile (and depth range for light culling)
+        scheduler.parallelFor(bands, 1, [this, bands](size_t begin, size_t end, unsigned int) {
+            PROFILE_WORK(zone, "bin count");
+            for (size_t band = begin; band < end; ++band) {
+                int rowStart = gridH * (int)band / bands;
+                int rowEnd = gridH * ((int)band + 1) / bands;
+
+                for (size_t i = 0; i < triControl.size(); ++i) {
+                    auto& t = triControl[i];
+
+                    //convert triangle to grid (rows of this band only)
+                    int startY = std::max(t.minY / tileSize, rowStart);
+                    int endY = std::min(t.maxY / tileSize, rowEnd - 1);
+                    if (startY > endY) continue;
+                    int startX = t.minX / tileSize;
+                    int endX = t.maxX / tileSize;
+
+                    float minZ = std::min({ t.v[0].p[2], t.v[1].p[2], t.v[2].p[2] });
+                    float maxZ = std::max({ t.v[0].p[2], t.v[1].p[2], t.v[2].p[2] });
+
+                    for (int y = startY; y <= endY; ++y) {
+                        for (int x = startX; x <= endX; ++x) {
+                            int tileID = y * gridW + x;
+                            binOffset[tileID + 1]++;
+                            //box of the triangle clipped to this bin
+                            int bw = std::min(t.maxX, (x + 1) * tileSize - 1) - std::max(t.minX, x * tileSize) + 1;
+                            int bh = std::min(t.maxY, (y + 1) * tileSize - 1) - std::max(t.minY, y * tileSize) + 1;
+                            binCost[tileID] += triCost + pixelCost * (float)(bw * bh);
+                            tileMinZ[tileID] = std::min(tileMinZ[tileID], minZ);
+                            tileMaxZ[tileID] = std::max(tileMaxZ[tileID], maxZ);
+                        }
+                    }
+                }
+            }
+            });
+
+        //prefix sum -> where each tile's bin starts
+        for (int tileID = 0; tileID < tileCount; ++tileID)
+            binOffset[tileID + 1] += binOffset[tileID];
+        binIndices.resize(binOffset[tileCount]);
+        binCursor.assign(binOffset.begin(), binOffset.end() - 1);
+
+        //pass 2 - write indices (triangle order is kept inside each bin)
+        scheduler.parallelFor(bands, 1, [this, bands](size_t begin, size_t end, unsigned int) {
+            PROFILE_WORK(zone, "bin write");
+            for (size_t band = begin; band < end; ++band) {
+                int rowStart = gridH * (int)band / bands;
+                int rowEnd = gridH * ((int)band + 1) / bands;
+
+                for (size_t i = 0; i < triControl.size(); ++i) {
+                    auto& t = triControl[i];
+                    int startY = std::max(t.minY / tileSize, rowStart);
+                    int endY = std::min(t.maxY / tileSize, rowEnd - 1);
+                    int startX = t.minX / tileSize;
+                    int endX = t.maxX / tileSize;
+
+                    for (int y = startY; y <= endY; ++y)
+                        for (int x = startX; x <= endX; ++x)
+                            binIndices[binCursor[y * gridW + x]++] = (unsigned int)i;
+                }
+            }
+            });
+    }
 
-        //triangle loop - run through every tri
-        for (int i = 0; i < triControl.size(); ++i) {
-            auto& t = triControl[i];
+    //turn the bins into raster tasks, heaviest first
+    //a bin costing more than a quarter of one thread's share is cut into horizontal strips
+    //(whole micro tile rows, so HiZ and the 8x8 walk line up) - each strip redoes triangle setup,
+    //so only bins that would otherwise hold up the barrier are split
+    void buildRasterTasks() {
+        rasterTasks.clear();
+        int tileCount = gridW * gridH;
+        float total = 0.f;
+        for (int tileID = 0; tileID < tileCount; ++tileID) total += binCost[tileID];
+        size_t threads = scheduler.workerCount();
+        float limit = threads > 1 ? total / (float)(threads * 4) : total + 1.f;
+        int maxStrips = tileSize / HiZ::size;
+
+        for (int tileID = 0; tileID < tileCount; ++tileID) {
+            if (binOffset[tileID] == binOffset[tileID + 1]) continue;
+            int yStart = (tileID / gridW) * tileSize;
+            int yEnd = std::min(yStart + tileSize, (int)canvasH);
+            int strips = std::clamp((int)std::ceil(binCost[tileID] / limit), 1, maxStrips);
+            int stripH = ((yEnd - yStart + strips - 1) / strips + HiZ::size - 1) & ~(HiZ::size - 1);
+            for (int y = yStart; y < yEnd; y += stripH) {
+                int y1 = std::min(y + stripH, yEnd);
+                rasterTasks.push_back({ tileID, y, y1, binCost[tileID] * (float)(y1 - y) / (float)(yEnd - yStart) });
+            }
+        }
+        std::sort(rasterTasks.begin(), rasterTasks.end(), [](const RasterTask& a, const RasterTask& b) { return a.cost > b.cost; });
+
+        //parallelFor starts each worker on its own slice of the list - deal the sorted tasks round robin
+        //into the slices, so every worker begins with its share of the heavy tiles
+        unsigned int workers = scheduler.workerCount();
+        if (workers > 1) {
+            rasterSorted.assign(rasterTasks.begin(), rasterTasks.end());
+            size_t count = rasterTasks.size(), next = 0;
+            for (size_t j = 0; next < count; ++j) {
+                for (unsigned int i = 0; i < workers; ++i) {
+                    Scheduler::Range slice = Scheduler::slice(count, i, workers);
+                    if (slice.begin + j < slice.end) rasterTasks[slice.begin + j] = rasterSorted[next++];
+                }
+            }
+        }
+    }
+
+    //idle time at the raster barrier - every thread waits for the last one to finish
+    void recordIdle() {
+        auto last = *std::max_element(threadRasterEnd.begin(), threadRasterEnd.end());
+        for (size_t i = 0; i < threadIdle.size(); i++)
+            threadIdle[i] += std::chrono::duration<double, std::milli>(last - threadRasterEnd[i]).count();
+        idleFrames++;
+    }
 
-            //convert triangle to grid
-            int startX = t.minX / tileSize;
-            int endX = t.maxX / tileSize;
-            int startY = t.minY / tileSize;
-            int endY = t.maxY / tileSize;
+    //print the average idle time per thread since the last report, then reset
+    void reportIdle() {
+        if (idleFrames == 0) return;
+        double sum = 0.0, worst = 0.0;
+        std::cout << "raster idle (ms/frame):";
+        for (double& t : threadIdle) {
+            double avg = t / idleFrames;
+            std::cout << " " << avg;
+            sum += avg;
+            worst = std::max(worst, avg);
+            t = 0.0;
+        }
+        std::cout << " | mean " << sum / threadIdle.size() << " max " << worst << "\n";
+        idleFrames = 0;
+    }
 
-            for (int y = startY; y <= endY; ++y) {
-                for (int x = startX; x <= endX; ++x) {
-                    tileTList[y * gridW + x].push_back(i);
+    //add up the workers' counters for the frame (and reset them)
+    void collectStats() {
+        frameStats = PipelineStats();
+        for (ThreadStats& t : threadStats) {
+            frameStats.geom.add(t.geom);
+            frameStats.raster.add(t.raster);
+            t = ThreadStats();
+        }
+        frameStats.meshes = meshTransforms.size();
+        frameStats.transformed = transformsUpdated;
+        frameStats.binRefs = binIndices.size();
+        frameStats.bins = (unsigned long long)gridW * gridH;
+        for (int tileID = 0; tileID < gridW * gridH; tileID++)
+            if (binOffset[tileID + 1] > binOffset[tileID]) frameStats.binsUsed++;
+        statsTotal.add(frameStats);
+        statsFrames++;
+    }
+
+    //print the average pipeline statistics per frame since the last report, then reset
+    void reportStats() {
+        if (statsFrames == 0) return;
+        statsTotal.print(statsFrames);
+        statsTotal = PipelineStats();
+        statsFrames = 0;
+    }
+
+    //buffers for the debug view (before the raster pass)
+    void setupDebugView(Renderer& r) {
+        unsigned int pitch = (r.canvas.getWidth() + 15) & ~15u;
+        if (debugView == DebugView::Overdraw) overdraw.assign((size_t)pitch * r.canvas.getHeight(), 0);
+        if (debugView == DebugView::TileCost) taskTime.assign(rasterTasks.size(), 0.0);
+        for (ThreadStats& t : threadStats) {
+            t.raster.overdraw = debugView == DebugView::Overdraw ? overdraw.data() : nullptr;
+            t.raster.overdrawPitch = pitch;
+        }
+    }
+
+    //replace the frame with the debug view heat map
+    //overdraw: black = never written, 8 or more writes = white
+    //tile cost: raster time of each bin relative to the slowest bin
+    void drawDebugView(Renderer& r) {
+        unsigned int w = r.canvas.getWidth(), h = r.canvas.getHeight();
+        unsigned int pitch = (w + 15) & ~15u;
+        unsigned char cr, cg, cb;
+        if (debugView == DebugView::Overdraw) {
+            for (unsigned int y = 0; y < h; y++) {
+                unsigned int* row = r.canvas.getRow(y);
+                for (unsigned int x = 0; x < w; x++) {
+                    heatColour(overdraw[(size_t)y * pitch + x] / 8.f, cr, cg, cb);
+                    row[x] = GamesEngineeringBase::Window::pack(cr, cg, cb);
                 }
             }
+            return;
+        }
+
+        tileTime.assign((size_t)gridW * gridH, 0.0);
+        for (size_t i = 0; i < rasterTasks.size(); i++) tileTime[rasterTasks[i].tileID] += taskTime[i];
+        double slowest = std::max(*std::max_element(tileTime.begin(), tileTime.end()), 1e-9);
+        for (int tileID = 0; tileID < gridW * gridH; tileID++) {
+            heatColour((float)(tileTime[tileID] / slowest), cr, cg, cb);
+            unsigned int c = GamesEngineeringBase::Window::pack(cr, cg, cb);
+            int x0 = (tileID % gridW) * tileSize, y0 = (tileID / gridW) * tileSize;
+            int x1 = std::min(x0 + tileSize, (int)w), y1 = std::min(y0 + tileSize, (int)h);
+            for (int y = y0; y < y1; y++)
+                std::fill(r.canvas.getRow(y) + x0, r.canvas.getRow(y) + x1, c);
+        }
+    }
+
+    //build the list of local lights whose sphere touches the tile's view space box
+    //box = tile rect in screen space extruded over the depth range of its triangles
+    void cullLights(int tileID, int xStart, int yStart, int yEnd, std::vector<unsigned int>& out) {
+        out.clear();
+        if (frameLights.empty()) return;
+
+        const ShadeContext& c = frameShade;
+        float x0 = (float)xStart, x1 = (float)(xStart + tileSize);
+        float y0 = (float)yStart, y1 = (float)yEnd;
+        float dA = c.zA / (tileMinZ[tileID] + c.zB);
+        float dB = c.zA / (tileMaxZ[tileID] + c.zB);
+        float dMin = std::min(dA, dB), dMax = std::max(dA, dB);
+
+        float sx0 = x0 * c.kx + c.bx, sx1 = x1 * c.kx + c.bx;
+        float sy0 = y0 * c.ky + c.by, sy1 = y1 * c.ky + c.by;
+        float minX = std::min({ sx0 * dMin, sx0 * dMax, sx1 * dMin, sx1 * dMax });
+        float maxX = std::max({ sx0 * dMin, sx0 * dMax, sx1 * dMin, sx1 * dMax });
+        float minY = std::min({ sy0 * dMin, sy0 * dMax, sy1 * dMin, sy1 * dMax });
+        float maxY = std::max({ sy0 * dMin, sy0 * dMax, sy1 * dMin, sy1 * dMax });
+        float minZ = -dMax, maxZ = -dMin;
+
+        for (unsigned int i = 0; i < frameLights.size(); i++) {
+            const LightView& l = frameLights[i];
+            //closest point on box to light centre
+            float dx = l.px - std::clamp(l.px, minX, maxX);
+            float dy = l.py - std::clamp(l.py, minY, maxY);
+            float dz = l.pz - std::clamp(l.pz, minZ, maxZ);
+            if (dx * dx + dy * dy + dz * dz < l.radius * l.radius)
+                out.push_back(i);
         }
     }
 
-    void executerasterizeState(int threadID) {
+    void executerasterizeState(unsigned int threadID, const RasterTask& task) {
         //pointers
         Renderer& r = *currentRenderer;
-        Light light = *currentLight;
-
-        while (true) {
-            //grab next tile
-            size_t tileID = pTileCount.fetch_add(1);
-            //if out of bound then breakl (none left)
-            if (tileID >= tileTList.size()) break;
-
-            //calculate bounds
-            int gridX = tileID % gridW;
-            int gridY = tileID / gridW;
-
-            int xStart = gridX * tileSize;
-            int yStart = gridY * tileSize;
-
-            //loop through tri in this grid
-            for (int triIdx : tileTList[tileID]) {
-                //tri been processed
-                auto& pTri = triControl[triIdx];
-                //redo triangle
-                triangle tri(pTri.v[0], pTri.v[1], pTri.v[2]);
-                //draw 
-                tri.drawClipped(r, light, pTri.ka, pTri.kd, xStart, yStart, xStart + tileSize, yStart + tileSize);
+        ShadeContext ctx = frameShade;
+        std::vector<unsigned int>& tileLights = threadTileLights[threadID];
+
+        //msaa - draw into the thread's sample tile, resolve when the tile is done
+        SampleTile* msaa = nullptr;
+        if (r.samples == SampleTile::samples) {
+            msaa = &threadSampleTiles[threadID];
+            if (msaa->size != (unsigned int)tileSize) msaa->create(tileSize);
+        }
+
+        int tileID = task.tileID;
+
+        //calculate bounds
+        int xStart = (tileID % gridW) * tileSize;
+        int yStart = task.yStart;
+        int xEnd = xStart + tileSize;
+        int yEnd = task.yEnd;
+
+        unsigned int binStart = binOffset[tileID];
+        unsigned int binEnd = binOffset[tileID + 1];
+
+        //lights for this tile only
+        cullLights(tileID, xStart, yStart, yEnd, tileLights);
+        ctx.tileLights = tileLights.data();
+        ctx.tileLightCount = (unsigned int)tileLights.size();
+
+        if (msaa) msaa->begin(r.canvas, xStart, yStart, std::min(tileSize, (int)canvasW - xStart), yEnd - yStart);
+
+        RasterStats* stats = &threadStats[threadID].raster;
+
+        //micro triangles are batched (flushed before any normal triangle so draw order is kept)
+        MicroBatch micro;
+        const mainTri* microTris[MicroBatch::size] = {};
+
+        //loop through tri in this grid
+        for (unsigned int b = binStart; b < binEnd; b++) {
+            //tri been processed
+            auto& pTri = triControl[binIndices[b]];
+            if (pTri.micro && !msaa) {
+                microTris[micro.count] = &pTri;
+                if (micro.add(pTri.v)) flushMicro(micro, microTris, r, ctx, stats, xStart, yStart, xEnd, yEnd);
+                continue;
+            }
+            flushMicro(micro, microTris, r, ctx, stats, xStart, yStart, xEnd, yEnd);
+
+            //redo triangle
+            triangle tri(pTri.v[0], pTri.v[1], pTri.v[2]);
+            //draw (shader picked per triangle, pixel loop is specialised)
+            switch (pTri.shading) {
+            case ShadingModel::Unlit: drawTri<UnlitShader>(tri, r, ctx, pTri.mat, msaa, stats, xStart, yStart, xEnd, yEnd); break;
+            case ShadingModel::Flat: drawTri<FlatShader>(tri, r, ctx, pTri.mat, msaa, stats, xStart, yStart, xEnd, yEnd); break;
+            case ShadingModel::Gouraud: drawTri<GouraudShader>(tri, r, ctx, pTri.mat, msaa, stats, xStart, yStart, xEnd, yEnd); break;
+            case ShadingModel::Phong: drawTri<PhongShader>(tri, r, ctx, pTri.mat, msaa, stats, xStart, yStart, xEnd, yEnd); break;
+            case ShadingModel::Textured: drawTri<TexturedShader>(tri, r, ctx, pTri.mat, msaa, stats, xStart, yStart, xEnd, yEnd); break;
             }
         }
+        flushMicro(micro, microTris, r, ctx, stats, xStart, yStart, xEnd, yEnd);
+
+        if (msaa) msaa->resolve(r.canvas);
     }
 
+    //set up and draw the batched micro triangles (if any)
+    void flushMicro(MicroBatch& micro, const mainTri* const* tris, Renderer& r, const ShadeContext& ctx, RasterStats* stats, int xStart, int yStart, int xEnd, int yEnd) {
+        if (micro.count == 0) return;
+        micro.setup(xStart, yStart, std::min(xEnd, (int)canvasW), std::min(yEnd, (int)canvasH));
+        for (unsigned int i = 0; i < micro.count; i++) {
+            const mainTri& pTri = *tris[i];
+            switch (pTri.shading) {
+            case ShadingModel::Unlit: drawMicro<UnlitShader>(r, ctx, pTri.mat, micro, i, stats); break;
+            case ShadingModel::Flat: drawMicro<FlatShader>(r, ctx, pTri.mat, micro, i, stats); break;
+            case ShadingModel::Gouraud: drawMicro<GouraudShader>(r, ctx, pTri.mat, micro, i, stats); break;
+            case ShadingModel::Phong: drawMicro<PhongShader>(r, ctx, pTri.mat, micro, i, stats); break;
+            case ShadingModel::Textured: drawMicro<TexturedShader>(r, ctx, pTri.mat, micro, i, stats); break;
+            }
+        }
+        micro.count = 0;
+    }
 
-    ~ThreadSys() {
-        stop.store(true);
-        start.fetch_add(1);
-        for (auto& t : threadPool) t.join();
+    //draw one triangle into the tile, multisampled if there is a sample tile
+    template <typename Shader>
+    void drawTri(triangle& tri, Renderer& r, const ShadeContext& ctx, const Material& mat, SampleTile* msaa, RasterStats* stats, int xStart, int yStart, int xEnd, int yEnd) {
+        if (msaa) tri.drawClippedMSAA<Shader>(r, ctx, mat, *msaa, stats);
+        else tri.drawClipped<Shader>(r, ctx, mat, xStart, yStart, xEnd, yEnd, &hiz, stats);
     }
+
 };
 
 struct MeshSoA {
     std::vector<float> x, y, z;
     size_t size = 0;
 
-    void init(const std::vector<Vertex>& verts) {
+    void init(const MeshBuffer<Vertex>& verts) {
         size = verts.size();
         x.resize(size); y.resize(size); z.resize(size);
         for (size_t i = 0; i < size; i++) {
@@ -324,45 +945,10 @@ struct MeshSoA {
     }
 };
 
+//project every vertex (transform, divide by w, viewport) with the CPU's widest kernel
 void simdSet(const MeshSoA& in, MeshSoA& out, const matrix& m, float w, float h) {
-    //Load
     const float* mat = reinterpret_cast<const float*>(&m);
-    __m128 m00 = _mm_set1_ps(mat[0]);  __m128 m01 = _mm_set1_ps(mat[1]);  __m128 m02 = _mm_set1_ps(mat[2]);  __m128 m03 = _mm_set1_ps(mat[3]);
-    __m128 m10 = _mm_set1_ps(mat[4]);  __m128 m11 = _mm_set1_ps(mat[5]);  __m128 m12 = _mm_set1_ps(mat[6]);  __m128 m13 = _mm_set1_ps(mat[7]);
-    __m128 m20 = _mm_set1_ps(mat[8]);  __m128 m21 = _mm_set1_ps(mat[9]);  __m128 m22 = _mm_set1_ps(mat[10]); __m128 m23 = _mm_set1_ps(mat[11]);
-    __m128 m30 = _mm_set1_ps(mat[12]); __m128 m31 = _mm_set1_ps(mat[13]); __m128 m32 = _mm_set1_ps(mat[14]); __m128 m33 = _mm_set1_ps(mat[15]);
-
-    __m128 vOne = _mm_set1_ps(1.0f);
-    __m128 vHalf = _mm_set1_ps(0.5f);
-    __m128 vW = _mm_set1_ps(w);
-    __m128 vH = _mm_set1_ps(h);
-
-    //Process 4 vert
-    for (size_t i = 0; i <= in.size - 4; i += 4) {
-        __m128 x = _mm_loadu_ps(&in.x[i]);
-        __m128 y = _mm_loadu_ps(&in.y[i]);
-        __m128 z = _mm_loadu_ps(&in.z[i]);
-        __m128 w_in = vOne;
-
-        //Multiply
-        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_add_ps(_mm_mul_ps(z, m20), _mm_mul_ps(w_in, m30)));
-        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_add_ps(_mm_mul_ps(z, m21), _mm_mul_ps(w_in, m31)));
-        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_add_ps(_mm_mul_ps(z, m22), _mm_mul_ps(w_in, m32)));
-        __m128 rw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m03), _mm_mul_ps(y, m13)), _mm_add_ps(_mm_mul_ps(z, m23), _mm_mul_ps(w_in, m33)));
-
-        //Div
-        rx = _mm_div_ps(rx, rw);
-        ry = _mm_div_ps(ry, rw);
-        rz = _mm_div_ps(rz, rw);
-
-        //Map
-        rx = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(rx, vOne), vHalf), vW);
-        ry = _mm_sub_ps(vH, _mm_mul_ps(_mm_mul_ps(_mm_add_ps(ry, vOne), vHalf), vH));
-
-        _mm_storeu_ps(&out.x[i], rx);
-        _mm_storeu_ps(&out.y[i], ry);
-        _mm_storeu_ps(&out.z[i], rz);
-    }
+    SimdKernels::active().projectPoints(mat, in.x.data(), in.y.data(), in.z.data(), out.x.data(), out.y.data(), out.z.data(), in.size, w, h);
 }
 
 // Main rendering function that processes a mesh, transforms its vertices, applies lighting, and draws triangles on the canvas.
@@ -532,25 +1118,26 @@ void sceneTest() {
     }
 }
 
-// Utility function to generate a random rotation matrix
+// Utility function to generate a random rotation
 // No input variables
-matrix makeRandomRotation() {
+quat makeRandomRotation() {
     RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
     unsigned int r = rng.getRandomInt(0, 3);
 
     switch (r) {
-    case 0: return matrix::makeRotateX(rng.getRandomFloat(0.f, 2.0f * M_PI));
-    case 1: return matrix::makeRotateY(rng.getRandomFloat(0.f, 2.0f * M_PI));
-    case 2: return matrix::makeRotateZ(rng.getRandomFloat(0.f, 2.0f * M_PI));
-    default: return matrix::makeIdentity();
+    case 0: return quat::fromAxisAngle(vec4(1.f, 0.f, 0.f, 0.f), rng.getRandomFloat(0.f, 2.0f * M_PI));
+    case 1: return quat::fromAxisAngle(vec4(0.f, 1.f, 0.f, 0.f), rng.getRandomFloat(0.f, 2.0f * M_PI));
+    case 2: return quat::fromAxisAngle(vec4(0.f, 0.f, 1.f, 0.f), rng.getRandomFloat(0.f, 2.0f * M_PI));
+    default: return quat();
     }
 }
 
 // Function to render a scene with multiple objects and dynamic transformations
-// No input variables
-void scene1() {
+// Input Variables:
+// - bench: Benchmark run (fixed frame count) or nullptr to run until escape
+void scene1(BenchRun* bench = nullptr) {
     ThreadSys pipeline;
-    std::vector<Mesh*> scene;
+    SceneGraph graph;
     Renderer renderer;
     matrix camera;
     Light L{ vec4(0.f, 1.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.2f, 0.2f, 0.2f) };
@@ -558,16 +1145,20 @@ void scene1() {
     bool running = true;
 
     // Create a scene of 40 cubes with random rotations
+    std::vector<SceneNode*> nodes;
     for (unsigned int i = 0; i < 20; i++) {
         Mesh* m = new Mesh();
         *m = Mesh::makeCube(1.f);
-        m->world = matrix::makeTranslation(-2.0f, 0.0f, (-3 * static_cast<float>(i))) * makeRandomRotation();
-        scene.push_back(m);
+        m->shading = ShadingModel::Flat; //cube faces are flat - no need to light per pixel
+        nodes.push_back(graph.add(m, Transform(vec4(-2.0f, 0.0f, (-3 * static_cast<float>(i))), makeRandomRotation())));
         m = new Mesh();
         *m = Mesh::makeCube(1.f);
-        m->world = matrix::makeTranslation(2.0f, 0.0f, (-3 * static_cast<float>(i))) * makeRandomRotation();
-        scene.push_back(m);
+        m->shading = ShadingModel::Flat;
+        nodes.push_back(graph.add(m, Transform(vec4(2.0f, 0.0f, (-3 * static_cast<float>(i))), makeRandomRotation())));
     }
+    std::vector<Mesh*>& scene = graph.meshes();
+    //per frame spin of the first two cubes
+    const quat spin[2] = { quat::fromRotateXYZ(0.1f, 0.1f, 0.0f), quat::fromRotateXYZ(0.0f, 0.1f, 0.2f) };
 
     float zoffset = 8.0f; // Initial camera Z-offset
     float step = -0.1f;  // Step size for camera movement
@@ -578,23 +1169,35 @@ void scene1() {
 
     // Main rendering loop
     while (running) {
+        //benchmark - fixed number of frames
+        if (bench && !bench->frame()) break;
         renderer.canvas.checkInput();
-        renderer.clear();
+        pipeline.clear(renderer);
 
         camera = matrix::makeTranslation(0, 0, -zoffset); // Update camera position
 
-        // Rotate the first two cubes in the scene
-        scene[0]->world = scene[0]->world * matrix::makeRotateXYZ(0.1f, 0.1f, 0.0f);
-        scene[1]->world = scene[1]->world * matrix::makeRotateXYZ(0.0f, 0.1f, 0.2f);
+        // Rotate the first two cubes in the scene (renormalised, so the spin never drifts into a scale or shear)
+        // - only their nodes are dirty, the other 38 cubes keep their world and view matrices
+        for (int i = 0; i < 2; i++) {
+            Transform t = nodes[i]->getLocal();
+            t.rotation = t.rotation * spin[i];
+            t.rotation.normalise();
+            nodes[i]->setLocal(t);
+        }
+        graph.update();
 
         if (renderer.canvas.keyPressed(VK_ESCAPE)) break;
 
+        pipeline.handleDebugKeys(renderer.canvas);
+
         zoffset += step;
         if (zoffset < -60.f || zoffset > 8.f) {
             step *= -1.f;
             if (++cycle % 2 == 0) {
                 end = std::chrono::high_resolution_clock::now();
                 std::cout << cycle / 2 << " :" << std::chrono::duration<double, std::milli>(end - start).count() << "ms\n";
+                pipeline.reportIdle();
+                pipeline.reportStats();
                 start = std::chrono::high_resolution_clock::now();
             }
         }
@@ -608,8 +1211,9 @@ void scene1() {
 }
 
 // Scene with a grid of cubes and a moving sphere
-// No input variables
-void scene2() {
+// Input Variables:
+// - bench: Benchmark run (fixed frame count) or nullptr to run until escape
+void scene2(BenchRun* bench = nullptr) {
     ThreadSys pipeline;
     Renderer renderer;
     matrix camera = matrix::makeIdentity();
@@ -617,8 +1221,9 @@ void scene2() {
 
     std::vector<Mesh*> scene;
 
-    struct rRot { float x; float y; float z; }; // Structure to store random rotation parameters
-    std::vector<rRot> rotations;
+    TransformSoA transforms;        // cube placements (orientation accumulated every frame)
+    std::vector<quat> rotations;    // per frame rotation of each cube
+    std::vector<matrix> worlds;     // world matrices built from transforms
 
     RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
 
@@ -627,12 +1232,15 @@ void scene2() {
         for (unsigned int x = 0; x < 8; x++) {
             Mesh* m = new Mesh();
             *m = Mesh::makeCube(1.f);
+            m->shading = ShadingModel::Flat;
             scene.push_back(m);
-            m->world = matrix::makeTranslation(-7.0f + (static_cast<float>(x) * 2.f), 5.0f - (static_cast<float>(y) * 2.f), -8.f);
-            rRot r{ rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f) };
-            rotations.push_back(r);
+            transforms.resize(transforms.size() + 1);
+            transforms.set(transforms.size() - 1, Transform(vec4(-7.0f + (static_cast<float>(x) * 2.f), 5.0f - (static_cast<float>(y) * 2.f), -8.f)));
+            float rx = rng.getRandomFloat(-.1f, .1f), ry = rng.getRandomFloat(-.1f, .1f), rz = rng.getRandomFloat(-.1f, .1f);
+            rotations.push_back(quat::fromRotateXYZ(rx, ry, rz));
         }
     }
+    worlds.resize(transforms.size());
 
     // Create a sphere and add it to the scene
     Mesh* sphere = new Mesh();
@@ -648,12 +1256,22 @@ void scene2() {
 
     bool running = true;
     while (running) {
+        //benchmark - fixed number of frames
+        if (bench && !bench->frame()) break;
         renderer.canvas.checkInput();
-        renderer.clear();
-
-        // Rotate each cube in the grid
-        for (unsigned int i = 0; i < rotations.size(); i++)
-            scene[i]->world = scene[i]->world * matrix::makeRotateXYZ(rotations[i].x, rotations[i].y, rotations[i].z);
+        pipeline.clear(renderer);
+
+        // Rotate each cube in the grid - accumulate in the quaternion (renormalised so it cannot drift),
+        // then build the chunk's world matrices in one batch
+        pipeline.parallelFor(rotations.size(), [&](size_t begin, size_t end, unsigned int) {
+            for (size_t i = begin; i < end; i++) {
+                quat q = transforms.getRotation(i) * rotations[i];
+                q.normalise();
+                transforms.setRotation(i, q);
+            }
+            transforms.build(begin, end, worlds.data() + begin);
+            for (size_t i = begin; i < end; i++) scene[i]->world = worlds[i];
+            });
 
         // Move the sphere back and forth
         sphereOffset += sphereStep;
@@ -663,12 +1281,16 @@ void scene2() {
             if (++cycle % 2 == 0) {
                 end = std::chrono::high_resolution_clock::now();
                 std::cout << cycle / 2 << " :" << std::chrono::duration<double, std::milli>(end - start).count() << "ms\n";
+                pipeline.reportIdle();
+                pipeline.reportStats();
                 start = std::chrono::high_resolution_clock::now();
             }
         }
 
         if (renderer.canvas.keyPressed(VK_ESCAPE)) break;
 
+        pipeline.handleDebugKeys(renderer.canvas);
+
         pipeline.run(renderer, scene, camera, L);
         renderer.present();
     }
@@ -678,7 +1300,8 @@ void scene2() {
 }
 
 //Scene 3 - wave (cube move up down sin, colour based off height)
-void scene3() {
+//bench - benchmark run (fixed frame count) or nullptr to run until escape
+void scene3(BenchRun* bench = nullptr) {
     struct Cube {
         Mesh* mesh;
         float x, z;
@@ -704,6 +1327,7 @@ void scene3() {
             Cube cube;
             cube.mesh = new Mesh();
             *cube.mesh = Mesh::makeCube(2.0f);
+            cube.mesh->shading = ShadingModel::Flat;
 
             //calc cubepos
             cube.x = (x * cubeGap) - offset;
@@ -726,17 +1350,23 @@ void scene3() {
     bool running = true;
 
     while (running) {
+        //benchmark - fixed number of frames
+        if (bench && !bench->frame()) break;
         renderer.canvas.checkInput();
-        renderer.clear();
+        pipeline.clear(renderer);
 
         if (renderer.canvas.keyPressed(VK_ESCAPE)) break;
 
+        pipeline.handleDebugKeys(renderer.canvas);
+
         time += 0.016f;
 
         if ((time * rotSpeed) > (2.0f * M_PI)) {
 
             auto end = std::chrono::high_resolution_clock::now();
             std::cout << cycle << " :" << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+            pipeline.reportIdle();
+            pipeline.reportStats();
 
             //reset
             start = std::chrono::high_resolution_clock::now();
@@ -751,28 +1381,29 @@ void scene3() {
         matrix camera = matrix::makeTranslation(0, -5.0f, -radius) * matrix::makeRotateX(0.5f) * matrix::makeRotateY(time * rotSpeed);
 
         //prevent write to every part of grid (slightly dif to other scenes)
-        std::vector<Mesh*> meshW;
-        meshW.reserve(waveGrid.size());
-
+        std::vector<Mesh*> meshW(waveGrid.size());
 
-        for (auto& cube : waveGrid) {
+        //every cube is independent - update them on the pipeline's workers
+        pipeline.parallelFor(waveGrid.size(), [&](size_t begin, size_t end, unsigned int) {
+            for (size_t i = begin; i < end; i++) {
+                Cube& cube = waveGrid[i];
 
+                float height = sin(cube.distance - (3.0f * time)) * 2.0f;
 
-            float height = sin(cube.distance - (3.0f * time)) * 2.0f;
 
+                //colour cubes based on height (if higher lighter to sim wave)
+                float colourMap = (height + 2.0f) / 4.0f;
+                colour c(0.3f * colourMap, 0.6f * colourMap, 1.0f);
+                //loop through colour each
+                for (auto& v : cube.mesh->vertices) {
+                    v.rgb = c;
+                }
 
-            //colour cubes based on height (if higher lighter to sim wave)
-            float colourMap = (height + 2.0f) / 4.0f;
-            colour c(0.3f * colourMap, 0.6f * colourMap, 1.0f);
-            //loop through colour each
-            for (auto& v : cube.mesh->vertices) {
-                v.rgb = c;
+                //apply height translate per frame
+                cube.mesh->world = matrix::makeTranslation(cube.x, height, cube.z);
+                meshW[i] = cube.mesh;
             }
-
-            //apply height translate per frame
-            cube.mesh->world = matrix::makeTranslation(cube.x, height, cube.z);
-            meshW.push_back(cube.mesh);
-        }
+            });
 
         pipeline.run(renderer, meshW, camera, L);
         renderer.present();
@@ -784,13 +1415,649 @@ void scene3() {
 }
 
 
+//Scene 4 - lights (grid of spheres on a floor of cubes, lit by many moving point lights + spot lights)
+void scene4() {
+    ThreadSys pipeline;
+    Renderer renderer;
+    //dim sun so the local lights show
+    Light L{ vec4(0.f, 1.f, 1.f, 0.f), colour(0.2f, 0.2f, 0.2f), colour(0.1f, 0.1f, 0.1f) };
+
+    RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+    std::vector<Mesh*> scene;
+
+    //floor
+    int floorSize = 16;
+    float floorGap = 2.0f;
+    float offset = (floorSize * floorGap) / 2.0f;
+    for (int x = 0; x < floorSize; x++) {
+        for (int z = 0; z < floorSize; z++) {
+            Mesh* m = new Mesh();
+            *m = Mesh::makeCube(2.0f);
+            m->world = matrix::makeTranslation((x * floorGap) - offset, -1.0f, (z * floorGap) - offset);
+            scene.push_back(m);
+        }
+    }
+
+    //spheres on top
+    for (int x = 0; x < 4; x++) {
+        for (int z = 0; z < 4; z++) {
+            Mesh* m = new Mesh();
+            *m = Mesh::makeSphere(1.0f, 10, 20);
+            m->world = matrix::makeTranslation((x * 8.0f) - 12.0f, 1.0f, (z * 8.0f) - 12.0f);
+            scene.push_back(m);
+        }
+    }
+
+    //point lights orbit the centre at different speeds/heights
+    struct Orbit { float radius; float speed; float phase; float height; };
+    std::vector<Orbit> orbits;
+    std::vector<LocalLight> lights;
+    for (int i = 0; i < 64; i++) {
+        LocalLight l;
+        l.type = LightType::Point;
+        l.L = colour(rng.getRandomFloat(0.2f, 1.0f), rng.getRandomFloat(0.2f, 1.0f), rng.getRandomFloat(0.2f, 1.0f));
+        l.radius = 5.0f;
+        lights.push_back(l);
+        orbits.push_back({ rng.getRandomFloat(2.0f, 15.0f), rng.getRandomFloat(0.2f, 1.0f), rng.getRandomFloat(0.f, 2.0f * M_PI), rng.getRandomFloat(1.0f, 3.0f) });
+    }
+
+    //spot lights in the corners pointing at the middle
+    for (int i = 0; i < 4; i++) {
+        LocalLight l;
+        l.type = LightType::Spot;
+        float a = (0.25f + 0.5f * i) * M_PI;
+        l.position = vec4(cos(a) * 14.0f, 8.0f, sin(a) * 14.0f);
+        l.direction = vec4(-cos(a) * 14.0f, -8.0f, -sin(a) * 14.0f, 0.0f);
+        l.direction.normalise();
+        l.L = colour(1.0f, 1.0f, 0.8f);
+        l.radius = 30.0f;
+        l.cosInner = 0.97f;
+        l.cosOuter = 0.93f;
+        lights.push_back(l);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int cycle = 1;
+    float time = 0.0f;
+
+    bool running = true;
+    while (running) {
+        renderer.canvas.checkInput();
+        pipeline.clear(renderer);
+
+        if (renderer.canvas.keyPressed(VK_ESCAPE)) break;
+
+        pipeline.handleDebugKeys(renderer.canvas);
+
+        time += 0.016f;
+        if (time > (2.0f * M_PI)) {
+            auto end = std::chrono::high_resolution_clock::now();
+            std::cout << cycle << " :" << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+            pipeline.reportIdle();
+            pipeline.reportStats();
+            start = std::chrono::high_resolution_clock::now();
+            cycle++;
+            time = 0.0f;
+        }
+
+        //move point lights
+        for (unsigned int i = 0; i < orbits.size(); i++) {
+            float a = orbits[i].phase + time * orbits[i].speed;
+            lights[i].position = vec4(cos(a) * orbits[i].radius, orbits[i].height, sin(a) * orbits[i].radius);
+        }
+
+        matrix camera = matrix::makeTranslation(0, -2.0f, -30.0f) * matrix::makeRotateX(0.6f) * matrix::makeRotateY(time * 0.25f);
+
+        pipeline.run(renderer, scene, camera, L, &lights);
+        renderer.present();
+    }
+
+    for (auto& m : scene)
+        delete m;
+}
+
+//Scene 5 - textures (checker floor running into the distance for mip-mapping + spinning textured cubes)
+void scene5() {
+    ThreadSys pipeline;
+    Renderer renderer;
+    Light L{ vec4(0.f, 1.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.2f, 0.2f, 0.2f) };
+
+    //texture from file if there is one, otherwise a checker board
+    //4x msaa (4 coverage/depth samples, one shade per pixel)
+    renderer.setSamples(4);
+
+    Texture checker;
+    if (!checker.load("texture.png"))
+        checker.makeChecker(256, 8, colour(0.9f, 0.9f, 0.9f), colour(0.2f, 0.3f, 0.8f));
+
+    std::vector<Mesh*> scene;
+
+    //floor - texture repeated 40 times along each side
+    Mesh* floor = new Mesh();
+    *floor = Mesh::makePlane(160.0f, 40, 40.0f);
+    floor->shading = ShadingModel::Textured;
+    floor->texture = &checker;
+    floor->world = matrix::makeTranslation(0.0f, -2.0f, 0.0f);
+    scene.push_back(floor);
+
+    //cubes
+    for (int i = 0; i < 8; i++) {
+        Mesh* m = new Mesh();
+        *m = Mesh::makeCube(2.0f);
+        m->shading = ShadingModel::Textured;
+        m->texture = &checker;
+        scene.push_back(m);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int cycle = 1;
+    float time = 0.0f;
+
+    bool running = true;
+    while (running) {
+        renderer.canvas.checkInput();
+        pipeline.clear(renderer);
+
+        if (renderer.canvas.keyPressed(VK_ESCAPE)) break;
+
+        pipeline.handleDebugKeys(renderer.canvas);
+
+        time += 0.016f;
+        if (time > (2.0f * M_PI)) {
+            auto end = std::chrono::high_resolution_clock::now();
+            std::cout << cycle << " :" << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+            pipeline.reportIdle();
+            pipeline.reportStats();
+            start = std::chrono::high_resolution_clock::now();
+            cycle++;
+            time = 0.0f;
+        }
+
+        //cubes in a ring - all share one orientation
+        quat spin = quat::fromRotateXYZ(time, time * 0.5f, 0.0f);
+        for (int i = 0; i < 8; i++) {
+            float a = i * (0.25f * M_PI);
+            scene[i + 1]->world = Transform(vec4(cos(a) * 6.0f, 0.0f, sin(a) * 6.0f - 12.0f), spin).toMatrix();
+        }
+
+        matrix camera = matrix::makeTranslation(0, 0, -2.0f) * matrix::makeRotateX(0.2f);
+
+        pipeline.run(renderer, scene, camera, L);
+        renderer.present();
+    }
+
+    for (auto& m : scene)
+        delete m;
+}
+
+// Model viewer - streams OBJ or .mesh files in on background threads (the window opens straight away
+// and each model appears once it has loaded), scales each one to fit and places them in a row, with
+// the camera circling around them
+// Input Variables:
+// - files: Model files (see MeshIO::load)
+void sceneModel(const std::vector<std::string>& files) {
+    ThreadSys pipeline;
+    Renderer renderer;
+    Light L{ vec4(0.f, 1.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.2f, 0.2f, 0.2f) };
+
+    SceneList scene;
+    AssetStreamer streamer(scene);
+    for (size_t i = 0; i < files.size(); i++) {
+        float x = ((float)i - (files.size() - 1) * 0.5f) * 7.0f;
+        streamer.load(files[i], [x](Mesh& mesh) {
+            //fit the bounding sphere (around the model's origin) to a radius of 3
+            float fit = mesh.boundSphereRad > 0.f ? 3.0f / mesh.boundSphereRad : 1.0f;
+            mesh.world = Transform(vec4(x, 0.0f, 0.0f), quat(), fit).toMatrix();
+        });
+    }
+    float distance = 8.0f + files.size() * 3.5f;
+
+    auto opened = std::chrono::high_resolution_clock::now();
+    auto start = opened;
+    int cycle = 1;
+    float time = 0.0f;
+    bool reported = false;
+
+    bool running = true;
+    while (running) {
+        renderer.canvas.checkInput();
+
+        //new models join at the frame boundary
+        if (scene.flip()) {
+            auto now = std::chrono::high_resolution_clock::now();
+            std::cout << scene.current().size() << "/" << files.size() << " models streamed in after "
+                << std::chrono::duration<double, std::milli>(now - opened).count() << "ms\n";
+        }
+        if (!reported && streamer.inFlight() == 0 && streamer.failed()) {
+            std::cout << streamer.failed() << " models could not be loaded\n";
+            reported = true;
+        }
+
+        pipeline.clear(renderer);
+
+        if (renderer.canvas.keyPressed(VK_ESCAPE)) break;
+
+        pipeline.handleDebugKeys(renderer.canvas);
+
+        time += 0.016f;
+        if (time > (2.0f * M_PI)) {
+            auto end = std::chrono::high_resolution_clock::now();
+            std::cout << cycle << " :" << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+            pipeline.reportStats();
+            start = std::chrono::high_resolution_clock::now();
+            cycle++;
+            time = 0.0f;
+        }
+
+        matrix camera = matrix::makeTranslation(0.0f, 0.0f, -distance) * matrix::makeRotateX(0.3f) * matrix::makeRotateY(time);
+
+        pipeline.run(renderer, scene.current(), camera, L);
+        renderer.present();
+    }
+}
+
+// Thread scaling bench - renders the wave scene for a fixed number of frames at 1 .. N workers
+// (doubling, plus one per physical core and one per logical processor) and prints ms/frame,
+// speedup over one worker and parallel efficiency
+// Input Variables:
+// - frames: Timed frames per worker count (a few warm up frames run first so bin tuning settles)
+// - pin: Pin each worker to its own logical processor
+void benchThreads(int frames = 200, bool pin = false) {
+    ThreadSys pipeline;
+    Renderer renderer;
+    Light L{ vec4(0.f, 1.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.2f, 0.2f, 0.2f) };
+
+    CpuTopology topology = CpuTopology::detect();
+    unsigned int logical = (unsigned int)topology.cpus.size(), physical = topology.physicalCores();
+    std::cout << "cpus: " << logical << " logical, " << physical << " physical (" << topology.physicalCores(true) << " performance)"
+        << (topology.hybrid() ? ", hybrid" : "") << "\n";
+
+    std::vector<unsigned int> counts;
+    for (unsigned int n = 1; n < logical; n *= 2) counts.push_back(n);
+    counts.push_back(physical);
+    counts.push_back(logical);
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+
+    //wave grid (same as scene 3, but stepped by frame number so every run draws the same frames)
+    std::vector<Mesh*> scene;
+    for (int x = 0; x < 25; x++)
+        for (int z = 0; z < 25; z++) {
+            Mesh* m = new Mesh();
+            *m = Mesh::makeCube(2.0f);
+            m->shading = ShadingModel::Flat;
+            m->world = matrix::makeTranslation(x * 2.0f - 25.0f, 0.0f, z * 2.0f - 25.0f);
+            scene.push_back(m);
+        }
+
+    double baseline = 0.0;
+    for (unsigned int n : counts) {
+        ThreadConfig config = ThreadConfig::defaults(topology);
+        config.workers = n;
+        config.pin = pin;
+        pipeline.configure(config);
+
+        //warm up covers bin size calibration
+        int warmUp = 16;
+        std::chrono::high_resolution_clock::time_point start;
+        for (int frame = 0; frame < warmUp + frames; frame++) {
+            if (frame == warmUp) start = std::chrono::high_resolution_clock::now();
+            renderer.canvas.checkInput();
+            pipeline.clear(renderer);
+
+            float time = (frame % 360) * 0.016f;
+            for (Mesh* m : scene) {
+                float x = m->world(0, 3), z = m->world(2, 3);
+                m->world = matrix::makeTranslation(x, sin(sqrt(x * x + z * z) - 3.0f * time) * 2.0f, z);
+            }
+            matrix camera = matrix::makeTranslation(0, -5.0f, -50.0f) * matrix::makeRotateX(0.5f) * matrix::makeRotateY(time * 0.5f);
+            pipeline.run(renderer, scene, camera, L);
+            renderer.present();
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frames;
+        if (baseline == 0.0) baseline = ms;
+        double speedup = baseline / ms;
+        std::cout << n << " workers: " << ms << " ms/frame, speedup " << speedup << ", efficiency " << 100.0 * speedup / n << "%\n";
+    }
+
+    for (auto& m : scene)
+        delete m;
+}
+
+// Stress scene for the benchmark runner - a grid of spinning cubes and/or one dense sphere
+// Input Variables:
+// - bench: Benchmark run (fixed frame count)
+// - cubes: Number of cubes (square grid)
+// - sphereTriangles: Approximate triangle count of the sphere (0 = no sphere)
+// - width, height: Resolution
+void stressScene(BenchRun& bench, int cubes, int sphereTriangles, unsigned int width = 1024, unsigned int height = 768) {
+    ThreadSys pipeline;
+    Renderer renderer(width, height);
+    Light L{ vec4(0.f, 1.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.2f, 0.2f, 0.2f) };
+
+    std::vector<Mesh*> scene;
+    //cube i is turned by X(time + i) * Y(time / 2) = X(i) * (X(time) * Y(time / 2)) - a fixed offset per cube
+    //composed with one rotation per frame, so the per cube update is a quaternion product (no trig)
+    TransformSoA transforms;
+    std::vector<quat> offsets;
+    std::vector<matrix> worlds(cubes);
+    transforms.resize(cubes);
+    int side = (int)std::ceil(std::sqrt((float)cubes));
+    //camera distance that keeps the whole grid in view: the renderer's 90 degree fov is vertical (tan 45 = 1), so a
+    //turned cube (bounding radius sqrt(3) / 2) is inside once its distance covers its offset from the axis plus
+    //radius * (1 + sqrt 2); a canvas taller than wide narrows the horizontal view, scaled by the aspect instead.
+    //5000 cubes sit at z = -57, inside the far plane at 100
+    float radius = std::sqrt(3.f) * 0.5f;
+    float depth = (side * 0.75f + radius * (1.f + std::sqrt(2.f))) / std::min((float)width / height, 1.f);
+    depth = std::max(depth, side * 0.75f + 4.f);
+    for (int i = 0; i < cubes; i++) {
+        Mesh* m = new Mesh();
+        *m = Mesh::makeCube(1.f);
+        m->shading = ShadingModel::Flat;
+        transforms.set(i, Transform(vec4((i % side - side * 0.5f) * 1.5f, (i / side - side * 0.5f) * 1.5f, -depth)));
+        offsets.push_back(quat::fromAxisAngle(vec4(1.f, 0.f, 0.f, 0.f), (float)i));
+        scene.push_back(m);
+    }
+    if (sphereTriangles > 0) {
+        //a sphere of rings x 2 rings segments has about 4 rings^2 triangles
+        unsigned int rings = std::max((unsigned int)std::sqrt(sphereTriangles / 4.0f), 4u);
+        Mesh* m = new Mesh();
+        *m = Mesh::makeSphere(3.f, rings, rings * 2);
+        m->shading = ShadingModel::Phong;
+        m->world = matrix::makeTranslation(0.f, 0.f, -8.f);
+        scene.push_back(m);
+    }
+
+    matrix camera = matrix::makeIdentity();
+    float time = 0.f;
+    while (bench.frame()) {
+        renderer.canvas.checkInput();
+        pipeline.clear(renderer);
+        time += 0.016f;
+        quat spin = quat::fromRotateXYZ(time, time * 0.5f, 0.f);
+        pipeline.parallelFor(cubes, [&](size_t begin, size_t end, unsigned int) {
+            for (size_t i = begin; i < end; i++) transforms.setRotation(i, offsets[i] * spin);
+            transforms.build(begin, end, worlds.data() + begin);
+            for (size_t i = begin; i < end; i++) scene[i]->world = worlds[i];
+            });
+        pipeline.run(renderer, scene, camera, L);
+        renderer.present();
+    }
+
+    for (auto& m : scene)
+        delete m;
+}
+
+// Benchmark runner - scene 1 - 3 and the stress scenes for a fixed frame count each, random numbers
+// seeded the same every run, frame times compared against a stored baseline
+// Input Variables:
+// - baselineFile: JSON baseline (written if it does not exist yet)
+// - update: Overwrite the baseline with this run
+// - threshold: Allowed slow down of the mean / p95 (0.05 = 5%)
+// Returns the number of regressions.
+int runBenchmarks(const std::string& baselineFile = "bench_baseline.json", bool update = false, double threshold = 0.05) {
+    constexpr int frames = 300;
+    constexpr unsigned int seed = 1234;
+    BenchBaseline current;
+    auto measure = [&](const std::string& name, auto&& body) {
+        RandomNumberGenerator::getInstance().seed(seed);
+        BenchRun run(frames);
+        body(run);
+        current.results[name] = BenchResult::from(run.frameMs);
+        std::cout << name << " done\n";
+    };
+
+    measure("scene1", [](BenchRun& run) { scene1(&run); });
+    measure("scene2", [](BenchRun& run) { scene2(&run); });
+    measure("scene3", [](BenchRun& run) { scene3(&run); });
+    for (int cubes : { 100, 1000, 5000 })
+        measure("cubes_" + std::to_string(cubes), [cubes](BenchRun& run) { stressScene(run, cubes, 0); });
+    for (int tris : { 20000, 200000 })
+        measure("sphere_" + std::to_string(tris), [tris](BenchRun& run) { stressScene(run, 0, tris); });
+    for (auto [w, h] : { std::pair<unsigned int, unsigned int>(640, 480), { 1280, 720 }, { 1920, 1080 } })
+        measure("res_" + std::to_string(w) + "x" + std::to_string(h), [w, h](BenchRun& run) { stressScene(run, 400, 20000, w, h); });
+
+    BenchBaseline baseline;
+    bool haveBaseline = baseline.load(baselineFile);
+    int regressions = baseline.compare(current, threshold);
+    if (update || !haveBaseline) {
+        if (current.save(baselineFile)) std::cout << "baseline written to " << baselineFile << "\n";
+    }
+    else std::cout << regressions << " regression(s) over " << threshold * 100.0 << "%\n";
+    return regressions;
+}
+
+// Micro benchmarks of the math and raster kernels (cycles per element, see MicroBench)
+void runMicroBenchmarks() {
+    MicroBench bench;
+    MicroBench::header();
+
+    //matrix * matrix
+    {
+        constexpr size_t n = 4096;
+        std::vector<matrix> a(n), out(n);
+        for (size_t i = 0; i < n; i++) a[i] = matrix::makeRotateXYZ(i * 0.01f, i * 0.02f, i * 0.03f);
+        matrix m = matrix::makeTranslation(1.f, 2.f, 3.f) * matrix::makeRotateY(0.5f);
+        bench.run("matrix * matrix", n, [&]() {
+            for (size_t i = 0; i < n; i++) out[i] = m * a[i];
+            });
+        MicroBench::keep(out[n / 2]);
+    }
+
+    //matrix * vec4
+    {
+        constexpr size_t n = 65536;
+        std::vector<vec4> v(n), out(n);
+        for (size_t i = 0; i < n; i++) v[i] = vec4((float)i, i * 0.5f, i * 0.25f);
+        matrix m = matrix::makeTranslation(1.f, 2.f, 3.f) * matrix::makeRotateY(0.5f);
+        bench.run("matrix * vec4", n, [&]() {
+            for (size_t i = 0; i < n; i++) out[i] = m * v[i];
+            });
+        MicroBench::keep(out[n / 2]);
+    }
+
+    //world matrix update of n spinning objects - matrix products vs quaternion + batched TRS build
+    {
+        constexpr size_t n = 4096;
+        std::vector<matrix> worlds(n);
+        TransformSoA transforms;
+        transforms.resize(n);
+        std::vector<quat> offsets(n);
+        for (size_t i = 0; i < n; i++) {
+            transforms.set(i, Transform(vec4((float)i, 1.f, -5.f)));
+            offsets[i] = quat::fromAxisAngle(vec4(1.f, 0.f, 0.f, 0.f), (float)i);
+        }
+        float time = 0.5f;
+        bench.run("world T * makeRotateXYZ", n, [&]() {
+            for (size_t i = 0; i < n; i++)
+                worlds[i] = matrix::makeTranslation(transforms.tx[i], 1.f, -5.f) * matrix::makeRotateXYZ(time + i, time * 0.5f, 0.f);
+            });
+        MicroBench::keep(worlds[n / 2]);
+        bench.run("world quat + TransformSoA", n, [&]() {
+            quat spin = quat::fromRotateXYZ(time, time * 0.5f, 0.f);
+            for (size_t i = 0; i < n; i++) transforms.setRotation(i, offsets[i] * spin);
+            transforms.build(0, n, worlds.data());
+            });
+        MicroBench::keep(worlds[n / 2]);
+    }
+
+    Renderer renderer;
+
+    //dispatched kernels, once per instruction set this CPU supports (the name shows the level)
+    {
+        constexpr size_t n = 65536;
+        MeshSoA in, out;
+        in.size = out.size = n;
+        in.x.resize(n); in.y.resize(n); in.z.resize(n);
+        out.x.resize(n); out.y.resize(n); out.z.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            in.x[i] = (float)(i % 97) * 0.1f;
+            in.y[i] = (float)(i % 89) * 0.1f;
+            in.z[i] = -5.f - (float)(i % 83) * 0.1f;
+        }
+        matrix p = matrix::makePerspective(1.5f, 4.f / 3.f, 0.1f, 100.f);
+        matrix m = matrix::makeTranslation(1.f, 2.f, 3.f) * matrix::makeRotateY(0.5f);
+        std::vector<vec4> v(n), vOut(n);
+        for (size_t i = 0; i < n; i++) v[i] = vec4((float)i, i * 0.5f, i * 0.25f);
+        std::vector<unsigned int> packed(n);
+        size_t pixels = (size_t)renderer.canvas.getWidth() * renderer.canvas.getHeight();
+
+        SimdLevel best = SimdKernels::forLevel(SimdLevel::AVX512).level;
+        for (SimdLevel level : { SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+            if (level > best) break;
+            SimdKernels::select(level);
+            std::string tag = std::string(" [") + simdLevelName(level) + "]";
+            bench.run(("simdSet" + tag).c_str(), n, [&]() { simdSet(in, out, p, 1024.f, 768.f); });
+            MicroBench::keep(out.x[n / 2]);
+            bench.run(("matrix::transform" + tag).c_str(), n, [&]() { m.transform(v.data(), vOut.data(), n); });
+            MicroBench::keep(vOut[n / 2]);
+            bench.run(("Zbuffer::clear" + tag).c_str(), pixels, [&]() { renderer.zbuffer.clear(); });
+            bench.run(("colour4::packSpan" + tag).c_str(), n, [&]() { colour4::packSpan(in.x.data(), in.y.data(), out.z.data(), packed.data(), n); });
+            MicroBench::keep(packed[n / 2]);
+        }
+        SimdKernels::select(best);
+    }
+
+    //colour::toRGB
+    {
+        constexpr size_t n = 65536;
+        std::vector<colour> c(n);
+        std::vector<unsigned char> out(n * 3);
+        for (size_t i = 0; i < n; i++) c[i] = colour((i % 256) / 200.f, (i % 128) / 100.f, (i % 64) / 50.f);
+        bench.run("colour::toRGB", n, [&]() {
+            for (size_t i = 0; i < n; i++) c[i].toRGB(out[i * 3], out[i * 3 + 1], out[i * 3 + 2]);
+            });
+        MicroBench::keep(out[n]);
+    }
+
+    //triangle::drawClipped - right triangles of edge size pixels, drawn slightly nearer every call
+    //so the depth test always passes (elements = pixels covered)
+    ShadeContext ctx;
+    ctx.sun = Light{ vec4(0.f, 1.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.2f, 0.2f, 0.2f) };
+    ctx.sun.omega_i.normalise();
+    ctx.setProjection(renderer.perspective, (float)renderer.canvas.getWidth(), (float)renderer.canvas.getHeight());
+    Material mat;
+    for (int size : { 2, 8, 32, 128, 512 }) {
+        Vertex v[3];
+        float x0 = 100.3f, y0 = 100.6f;
+        v[0].p = vec4(x0, y0, 0.5f);
+        v[1].p = vec4(x0 + size, y0, 0.5f);
+        v[2].p = vec4(x0, y0 + size, 0.5f);
+        for (Vertex& vert : v) {
+            vert.p[3] = 1.f;
+            vert.normal = vec4(0.f, 0.f, 1.f, 0.f);
+            vert.rgb = colour(0.8f, 0.4f, 0.2f);
+        }
+        //front facing winding
+        renderer.zbuffer.clear();
+        RasterStats covered;
+        triangle(v[0], v[1], v[2]).drawClipped<UnlitShader>(renderer, ctx, mat, 0, 0, 1024, 768, nullptr, &covered);
+        if (covered.tested == 0) {
+            std::swap(v[1], v[2]);
+            triangle(v[0], v[1], v[2]).drawClipped<UnlitShader>(renderer, ctx, mat, 0, 0, 1024, 768, nullptr, &covered);
+        }
+
+        renderer.zbuffer.clear();
+        float z = 0.9f;
+        auto draw = [&](auto shaderTag) {
+            using Shader = decltype(shaderTag);
+            z -= 1e-6f;
+            for (Vertex& vert : v) vert.p[2] = z;
+            triangle(v[0], v[1], v[2]).drawClipped<Shader>(renderer, ctx, mat, 0, 0, 1024, 768);
+        };
+        std::string name = "drawClipped unlit " + std::to_string(size) + "px";
+        bench.run(name.c_str(), covered.tested, [&]() { draw(UnlitShader()); });
+        name = "drawClipped phong " + std::to_string(size) + "px";
+        bench.run(name.c_str(), covered.tested, [&]() { draw(PhongShader()); });
+    }
+}
 
 // Entry point of the application
-// No input variables
-int main() {
+// Input Variables (command line):
+// --bench [baseline.json]: Run the benchmark suite and compare against the baseline (exit code 1 on a regression)
+// --bench-update [baseline.json]: Run the benchmark suite and store the results as the new baseline
+// --bench-threads: Thread scaling bench
+// --microbench: Math and raster kernel micro benchmarks
+// --model file [file ...]: View OBJ or .mesh models (streamed in while the window is open)
+// --convert in.obj out.mesh: Import an OBJ file and write it as a binary mesh file
+// --simd / --capture / --capture-lossless: Options placed before the mode (see below)
+int main(int argc, char** argv) {
+    //options before the mode:
+    //--simd sse2|avx2|avx512 caps the kernel level (default: the widest this CPU supports)
+    //--capture file / --capture-lossless file writes every presented frame (see FrameCapture::formatFor, "-" = raw
+    //  RGB on stdout, text output then goes to stderr); lossless waits for the writer rather than dropping frames
+    bool simdSelected = false;
+    while (argc > 2) {
+        std::string option = argv[1];
+        if (option == "--simd") {
+            std::string level = argv[2];
+            bool known = false;
+            for (SimdLevel l : { SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 })
+                if (level == simdLevelName(l)) {
+                    SimdKernels::select(l);
+                    known = true;
+                }
+            if (!known) {
+                std::cerr << "unknown simd level " << level << " (sse2, avx2 or avx512)\n";
+                return 1;
+            }
+            simdSelected = true;
+        }
+        else if (option == "--capture" || option == "--capture-lossless") {
+            std::string path = argv[2];
+            if (path == "-") std::cout.rdbuf(std::cerr.rdbuf());
+            if (!FrameCapture::instance().start(path, FrameCapture::formatFor(path), 8, option == "--capture-lossless")) {
+                std::cerr << "could not capture to " << path << " (a .ppm / .png name needs one %d for the frame number)\n";
+                return 1;
+            }
+            std::atexit([]() { FrameCapture::instance().stop(); });
+        }
+        else break;
+        argc -= 2;
+        argv += 2;
+    }
+    if (simdSelected) std::cout << "simd kernels: " << simdLevelName(SimdKernels::active().level) << "\n";
+    std::string mode = argc > 1 ? argv[1] : "";
+    std::string baselineFile = argc > 2 ? argv[2] : "bench_baseline.json";
+    if (mode == "--bench") return runBenchmarks(baselineFile) > 0 ? 1 : 0;
+    if (mode == "--bench-update") {
+        runBenchmarks(baselineFile, true);
+        return 0;
+    }
+    if (mode == "--bench-threads") {
+        benchThreads();
+        return 0;
+    }
+    if (mode == "--microbench") {
+        runMicroBenchmarks();
+        return 0;
+    }
+    if (mode == "--model" && argc > 2) {
+        sceneModel(std::vector<std::string>(argv + 2, argv + argc));
+        return 0;
+    }
+    if (mode == "--convert" && argc > 3) {
+        Mesh mesh;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!MeshIO::loadOBJ(argv[2], mesh)) {
+            std::cout << "could not import " << argv[2] << "\n";
+            return 1;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << argv[2] << ": " << mesh.vertices.size() << " vertices, " << mesh.triangles.size() << " triangles, imported in "
+            << std::chrono::duration<double, std::milli>(end - start).count() << "ms\n";
+        if (!MeshIO::saveBinary(mesh, argv[3])) {
+            std::cout << "could not write " << argv[3] << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
     scene3();
     //scene2();
     //scene3();
+    //scene4();
+    //scene5();
     //sceneTest(); 
 
 
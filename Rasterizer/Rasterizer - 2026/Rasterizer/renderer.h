@@ -1,9 +1,88 @@
 #pragma once
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <vector>
+#include <emmintrin.h>
 #include "GamesEngineeringBase.h"
 #include "zbuffer.h"
 #include "matrix.h"
+#include "profiler.h"
+#include "capture.h"
+
+// 4x multisampled colour and depth for one screen tile.
+// Each rasterizer thread keeps one: samples are filled from the canvas when a tile starts, triangles
+// write coverage/depth per sample (shading once per pixel), and resolve() averages the samples back
+// into the canvas when the tile is done. The whole tile stays in cache the entire time.
+class SampleTile {
+public:
+    static constexpr unsigned int samples = 4;
+    // Rotated grid sample positions relative to the pixel's sample point
+    static constexpr float offsets[samples][2] = { { -0.125f, -0.375f }, { 0.375f, -0.125f }, { -0.375f, 0.125f }, { 0.125f, 0.375f } };
+
+    int x0 = 0, y0 = 0;                 // tile top left corner (x0 a multiple of 4)
+    unsigned int w = 0, h = 0;          // tile size (edge tiles can be smaller than size)
+    unsigned int size = 0;              // allocated tile size
+    Zbuffer<float> depth;               // size x size, 4 samples
+    std::vector<unsigned int> colour;   // packed pixels, same row layout as depth (one row per sample)
+
+    // Allocate for tiles of up to _size x _size pixels
+    void create(unsigned int _size) {
+        size = _size;
+        depth.create(size, size, samples);
+        colour.assign(size * size * samples, 0);
+    }
+
+    // Returns the first colour sample s of local row y
+    unsigned int* row(unsigned int y, unsigned int s) {
+        return colour.data() + ((y * samples + s) * size);
+    }
+
+    // Start a tile - every sample takes the current canvas pixel, depth is reset to the far plane
+    // Input Variables:
+    // - canvas: Packed (RGBA8) canvas
+    // - x, y: Tile top left corner
+    // - _w, _h: Tile size
+    void begin(GamesEngineeringBase::Window& canvas, int x, int y, unsigned int _w, unsigned int _h) {
+        x0 = x;
+        y0 = y;
+        w = _w;
+        h = _h;
+        depth.clear();
+        for (unsigned int ly = 0; ly < h; ly++) {
+            const unsigned int* src = canvas.getRow(y0 + ly) + x0;
+            for (unsigned int s = 0; s < samples; s++)
+                std::copy(src, src + w, row(ly, s));
+        }
+    }
+
+    // Average the samples of every pixel and write the tile to the canvas
+    // Input Variables:
+    // - canvas: Packed (RGBA8) canvas
+    void resolve(GamesEngineeringBase::Window& canvas) {
+        for (unsigned int ly = 0; ly < h; ly++) {
+            unsigned int* s0 = row(ly, 0);
+            unsigned int* s1 = row(ly, 1);
+            unsigned int* s2 = row(ly, 2);
+            unsigned int* s3 = row(ly, 3);
+            //per byte average, 4 pixels at a time (result goes into sample 0)
+            unsigned int x = 0;
+            for (; x + 4 <= w; x += 4) {
+                __m128i a = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<__m128i*>(s0 + x)), _mm_loadu_si128(reinterpret_cast<__m128i*>(s1 + x)));
+                __m128i b = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<__m128i*>(s2 + x)), _mm_loadu_si128(reinterpret_cast<__m128i*>(s3 + x)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(s0 + x), _mm_avg_epu8(a, b));
+            }
+            for (; x < w; x++) {
+                unsigned int out = 0;
+                for (unsigned int shift = 0; shift < 32; shift += 8) {
+                    unsigned int sum = ((s0[x] >> shift) & 0xFF) + ((s1[x] >> shift) & 0xFF) + ((s2[x] >> shift) & 0xFF) + ((s3[x] >> shift) & 0xFF);
+                    out |= ((sum + 2) >> 2) << shift;
+                }
+                s0[x] = out;
+            }
+        }
+        canvas.writeTile(x0, y0, w, h, row(0, 0), samples * size);
+    }
+};
 
 // The `Renderer` class handles rendering operations, including managing the
 // Z-buffer, canvas, and perspective transformations for a 3D scene.
@@ -16,11 +95,18 @@ public:
     Zbuffer<float> zbuffer;                  // Z-buffer for depth management
     GamesEngineeringBase::Window canvas;     // Canvas for rendering the scene
     matrix perspective;                      // Perspective projection matrix
+    unsigned int samples = 1;                // Samples per pixel for the tile rasterizer (1 or 4)
 
     // Constructor initializes the canvas, Z-buffer, and perspective projection matrix.
-    Renderer() {
-        canvas.create(1024, 768, "Raster");  // Create a canvas with specified dimensions and title
-        zbuffer.create(1024, 768);           // Initialize the Z-buffer with the same dimensions
+    Renderer() : Renderer(1024, 768) {}
+
+    // Same at a chosen resolution (the aspect ratio follows the canvas)
+    // Input Variables:
+    // - width, height: Canvas size in pixels
+    Renderer(unsigned int width, unsigned int height) {
+        aspect = (float)width / (float)height;
+        canvas.create(width, height, "Raster", false, 0, 0, GamesEngineeringBase::PixelRGBA8); // Create a canvas with packed 32-bit pixels
+        zbuffer.create(width, height);       // Initialize the Z-buffer with the same dimensions
         perspective = matrix::makePerspective(fov, aspect, n, f); // Set up the perspective matrix
     }
 
@@ -30,8 +116,25 @@ public:
         zbuffer.clear(); // Reset the Z-buffer to the farthest depth
     }
 
-    // Presents the current canvas frame to the display.
+    // Clears rows y0 to y1 - 1 of the canvas and Z-buffer (used to clear the frame in parallel bands).
+    // Input Variables:
+    // - y0, y1: First row and one past the last row
+    void clearRows(unsigned int y0, unsigned int y1) {
+        canvas.clearRows(y0, y1);
+        zbuffer.clearRows(y0, y1);
+    }
+
+    // Selects the anti-aliasing mode of the tile rasterizer.
+    // Input Variables:
+    // - s: 1 (off) or 4 (4x MSAA - 4 depth/coverage samples, one shade per pixel); anything else is treated as 1
+    void setSamples(unsigned int s) {
+        samples = (s == SampleTile::samples) ? s : 1;
+    }
+
+    // Presents the current canvas frame to the display (and hands it to the frame capture if it is running).
     void present() {
+        PROFILE_ZONE("present");
+        FrameCapture::instance().submit(canvas); // Copy the frame for the capture writer (no-op when not capturing)
         canvas.present(); // Display the rendered frame
     }
 };
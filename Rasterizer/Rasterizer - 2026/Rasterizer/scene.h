@@ -0,0 +1,131 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "matrix.h"
+#include "mesh.h"
+#include "transform.h"
+
+// Node of the scene graph - a transform relative to its parent and (optionally) a mesh drawn with it.
+// Changing the local transform marks the node dirty and flags every ancestor as having a dirty
+// descendant, so SceneGraph::update only walks into the parts of the tree that moved.
+class SceneNode {
+public:
+    Mesh* mesh = nullptr; // drawn with this node's world matrix (not owned)
+
+    // Place the node relative to its parent
+    void setLocal(const Transform& t) {
+        local = t;
+        dirty = true;
+        for (SceneNode* p = parent; p && !p->dirtyBelow; p = p->parent) p->dirtyBelow = true;
+    }
+
+    const Transform& getLocal() const {
+        return local;
+    }
+
+    // World transform and matrix (as of the last SceneGraph::update)
+    const Transform& getWorld() const {
+        return world;
+    }
+
+    const matrix& getWorldMatrix() const {
+        return worldMatrix;
+    }
+
+    SceneNode* getParent() const {
+        return parent;
+    }
+
+    const std::vector<SceneNode*>& getChildren() const {
+        return children;
+    }
+
+private:
+    friend class SceneGraph;
+
+    Transform local;
+    Transform world;
+    matrix worldMatrix;
+    SceneNode* parent = nullptr;
+    std::vector<SceneNode*> children;
+    bool dirty = true;        // local transform changed since the last update
+    bool dirtyBelow = false;  // some descendant is dirty
+};
+
+// Hierarchy of transforms. update() recomputes world transforms only for dirty nodes and everything
+// below them, builds all the changed world matrices in one batch (TransformSoA) and copies them into
+// the nodes' meshes - static parts of the scene cost nothing per frame.
+class SceneGraph {
+public:
+    SceneGraph() {
+        nodes.push_back(std::make_unique<SceneNode>());
+    }
+
+    // The root node (identity transform, no mesh)
+    SceneNode* root() {
+        return nodes.front().get();
+    }
+
+    // Add a node
+    // Input Variables:
+    // - mesh: Mesh drawn with the node (nullptr for a pure transform node)
+    // - local: Transform relative to the parent
+    // - parent: Parent node (nullptr = root)
+    // Returns the new node (owned by the graph)
+    SceneNode* add(Mesh* mesh, const Transform& local = Transform(), SceneNode* parent = nullptr) {
+        if (!parent) parent = root();
+        nodes.push_back(std::make_unique<SceneNode>());
+        SceneNode* node = nodes.back().get();
+        node->mesh = mesh;
+        node->parent = parent;
+        parent->children.push_back(node);
+        node->setLocal(local);
+        if (mesh) drawList.push_back(mesh);
+        return node;
+    }
+
+    // Bring every world transform up to date
+    // Returns the number of nodes recomputed
+    size_t update() {
+        changed.clear();
+        visit(root(), false);
+        size_t n = changed.size();
+        if (n == 0) return 0;
+
+        batch.resize(n);
+        for (size_t i = 0; i < n; i++) batch.set(i, changed[i]->world);
+        worlds.resize(n);
+        batch.build(0, n, worlds.data());
+        for (size_t i = 0; i < n; i++) {
+            changed[i]->worldMatrix = worlds[i];
+            if (changed[i]->mesh) changed[i]->mesh->world = worlds[i];
+        }
+        return n;
+    }
+
+    // Meshes of every node, in the order they were added (the list to draw)
+    std::vector<Mesh*>& meshes() {
+        return drawList;
+    }
+
+private:
+    std::vector<std::unique_ptr<SceneNode>> nodes;
+    std::vector<Mesh*> drawList;
+    //scratch for update (kept between frames)
+    std::vector<SceneNode*> changed;
+    TransformSoA batch;
+    std::vector<matrix> worlds;
+
+    void visit(SceneNode* node, bool parentChanged) {
+        bool recompute = parentChanged || node->dirty;
+        if (recompute) {
+            node->world = node->parent ? node->parent->world * node->local : node->local;
+            changed.push_back(node);
+        }
+        if (recompute || node->dirtyBelow)
+            for (SceneNode* child : node->children) visit(child, recompute);
+        node->dirty = false;
+        node->dirtyBelow = false;
+    }
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "profiler.h"
+#include "topology.h"
+
+// Work stealing scheduler for the pipeline.
+// Every worker owns a small deque of index ranges. parallelFor deals the range out to all deques,
+// then each worker runs its own range from the front and, while its deque is empty, splits the rest
+// in half and pushes the upper half so there is something to steal (lazy binary splitting - chunks
+// get smaller only when other workers actually run out). A worker with nothing left steals the
+// oldest (largest) range from another deque.
+// The thread calling parallelFor takes part as worker 0 and the pool threads are workers 1 .. n-1,
+// unless the config says the caller should only wait - then the pool threads are workers 0 .. n-1.
+// Only one parallelFor runs at a time and only the owning thread calls it (no nesting).
+class Scheduler {
+public:
+    // Contiguous block of loop indices [begin, end)
+    struct Range {
+        size_t begin, end;
+    };
+
+    // Start the pool (does nothing if it is already running)
+    // Input Variables:
+    // - workers: Total workers including the calling thread (0 = one per hardware thread)
+    void start(unsigned int workers = 0) {
+        ThreadConfig config;
+        config.workers = workers ? workers : std::max(std::thread::hardware_concurrency(), 1u);
+        start(config);
+    }
+
+    // Start the pool from a thread config (does nothing if it is already running)
+    // Input Variables:
+    // - config: Worker count, whether the caller works and pinning (auto fields are resolved here)
+    void start(ThreadConfig config) {
+        if (!threads.empty() || !queues.empty()) return;
+        config.resolve(CpuTopology::detect());
+        unsigned int workers = std::max(config.workers, 1u);
+        callerWorks = config.mainThreadJoins;
+
+        queues = std::vector<Queue>(workers);
+        std::vector<int> cpus = config.pin ? config.cpus : std::vector<int>();
+        auto cpuFor = [&](unsigned int i) { return cpus.empty() ? -1 : cpus[i % cpus.size()]; };
+        if (callerWorks) {
+            if (cpus.size()) {
+                callerAffinity = ThreadAffinity::current();
+                pinThread(cpuFor(0));
+            }
+            Profiler::instance().nameThread("worker 0 (main)");
+        }
+        for (unsigned int i = callerWorks ? 1 : 0; i < workers; ++i) {
+            int cpu = cpuFor(i);
+            threads.emplace_back([this, i, cpu]() {
+                if (cpu >= 0) pinThread(cpu);
+                Profiler::instance().nameThread("worker " + std::to_string(i));
+                workerLoop(i);
+            });
+        }
+    }
+
+    // Stop and join the pool threads, and give the calling thread back the affinity it had before start
+    // pinned it (call from the thread that called start)
+    void stop() {
+        quit.store(true);
+        epoch.fetch_add(1);
+        for (auto& t : threads) t.join();
+        threads.clear();
+        queues.clear();
+        quit.store(false);
+        callerWorks = true;
+        callerAffinity.restore();
+        callerAffinity = ThreadAffinity();
+    }
+
+    // Workers taking part in parallelFor (pool threads + the caller if it joins)
+    unsigned int workerCount() const {
+        return (unsigned int)std::max<size_t>(queues.size(), 1);
+    }
+
+    // Slice of [0, count) that parallelFor hands to worker i first (sizes differ by at most one)
+    static Range slice(size_t count, unsigned int i, unsigned int n) {
+        return { count * i / n, count * (i + 1) / n };
+    }
+
+    // Run body over [0, count) across all workers and wait for it to finish
+    // Input Variables:
+    // - count: Number of loop indices
+    // - grain: Smallest chunk handed to body (0 = pick from count and worker count)
+    // - body: Called as body(begin, end, worker) - worker is 0 .. workerCount() - 1, so per worker
+    //         buffers can be indexed without locks
+    template <typename Body>
+    void parallelFor(size_t count, size_t grain, Body&& body) {
+        if (count == 0) return;
+        unsigned int n = workerCount();
+        if (grain == 0) grain = std::max<size_t>(count / (n * 8), 1);
+        //single worker (or tiny loop) - no need to wake anyone
+        if (callerWorks && (n == 1 || count <= grain)) {
+            body(0, count, 0u);
+            return;
+        }
+
+        using B = std::remove_reference_t<Body>;
+        job.call = [](void* ctx, size_t b, size_t e, unsigned int w) { (*static_cast<B*>(ctx))(b, e, w); };
+        job.ctx = (void*)&body;
+        job.grain = grain;
+        remaining.store(count);
+
+        //deal one contiguous slice to each worker
+        for (unsigned int i = 0; i < n; ++i) {
+            Range r = slice(count, i, n);
+            if (r.begin < r.end) queues[i].push(r);
+        }
+        epoch.fetch_add(1);
+
+        //caller works too (if configured to), then waits for the chunks still running on other workers
+        if (callerWorks) work(0);
+        while (remaining.load() > 0)
+            std::this_thread::yield();
+    }
+
+    ~Scheduler() {
+        if (!threads.empty()) stop();
+    }
+
+private:
+    // One worker's deque - owner pushes/pops at the back, thieves take from the front.
+    // The lock is only ever contended by a thief, and only when the owner touches the deque at the
+    // same moment (a range is split at most log2 times, so the deque stays tiny).
+    struct alignas(64) Queue {
+        static constexpr unsigned int capacity = 64;
+        Range items[capacity];
+        unsigned int head = 0, tail = 0; //ring indices (tail - head = size)
+        std::atomic<unsigned int> size{ 0 };
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+
+        void acquire() {
+            while (lock.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+        void release() {
+            lock.clear(std::memory_order_release);
+        }
+
+        bool push(const Range& r) {
+            acquire();
+            bool ok = tail - head < capacity;
+            if (ok) {
+                items[tail++ % capacity] = r;
+                size.store(tail - head);
+            }
+            release();
+            return ok;
+        }
+
+        bool popBack(Range& r) {
+            if (size.load() == 0) return false;
+            acquire();
+            bool ok = tail != head;
+            if (ok) {
+                r = items[--tail % capacity];
+                size.store(tail - head);
+            }
+            release();
+            return ok;
+        }
+
+        bool popFront(Range& r) {
+            if (size.load() == 0) return false;
+            acquire();
+            bool ok = tail != head;
+            if (ok) {
+                r = items[head++ % capacity];
+                size.store(tail - head);
+            }
+            release();
+            return ok;
+        }
+    };
+
+    // The running parallelFor (type erased body)
+    struct Job {
+        void (*call)(void*, size_t, size_t, unsigned int) = nullptr;
+        void* ctx = nullptr;
+        size_t grain = 1;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> threads;
+    Job job;
+    std::atomic<size_t> remaining{ 0 }; //loop indices not yet finished
+    std::atomic<unsigned int> epoch{ 0 }; //bumped for every parallelFor (and to stop)
+    std::atomic<bool> quit{ false };
+    bool callerWorks = true; //thread calling parallelFor is worker 0
+    ThreadAffinity callerAffinity; //caller's affinity from before start pinned it (saved = false if it was not pinned)
+
+    // Pool thread - sleep (yield) until a parallelFor starts, then work until it is done
+    void workerLoop(unsigned int self) {
+        unsigned int seen = 0;
+        while (true) {
+            while (epoch.load() == seen)
+                std::this_thread::yield();
+            seen = epoch.load();
+            if (quit.load()) return;
+            work(self);
+        }
+    }
+
+    // Run own ranges, then steal, until every index of the job has been run
+    void work(unsigned int self) {
+        unsigned int n = (unsigned int)queues.size();
+        while (remaining.load() > 0) {
+            Range r;
+            if (!queues[self].popBack(r)) {
+                bool stolen = false;
+                for (unsigned int k = 1; k < n && !stolen; ++k)
+                    stolen = queues[(self + k) % n].popFront(r);
+                if (!stolen) {
+                    std::this_thread::yield();
+                    continue;
+                }
+            }
+            run(self, r);
+        }
+    }
+
+    // Run one range, splitting off the upper half whenever this worker has nothing left to be stolen
+    void run(unsigned int self, Range r) {
+        Queue& q = queues[self];
+        size_t grain = job.grain;
+        while (r.begin < r.end) {
+            if (r.end - r.begin > grain * 2 && q.size.load() == 0) {
+                size_t mid = r.begin + (r.end - r.begin) / 2;
+                if (q.push({ mid, r.end })) {
+                    r.end = mid;
+                    continue;
+                }
+            }
+            size_t e = std::min(r.begin + grain, r.end);
+            job.call(job.ctx, r.begin, e, self);
+            remaining.fetch_sub(e - r.begin);
+            r.begin = e;
+        }
+    }
+};
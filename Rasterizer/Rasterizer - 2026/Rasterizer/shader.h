@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <immintrin.h>
+#include "mesh.h"
+#include "colour.h"
+#include "light.h"
+#include "texture.h"
+
+// Shading variants for the tile rasterizer.
+// Each shader has two parts:
+// - geometry(): runs once per triangle in the geometry stage (after transform, before binning)
+// - Pixel: per-triangle setup plus shade(), which lights four pixels at once
+// triangle::drawClipped<Shader> is instantiated per variant so the pixel loop has no shading branches.
+// All lighting is done in view space (normals, light directions and light positions).
+
+// Surface parameters shared by every triangle of a mesh
+struct Material {
+    float ka = 0.75f;                  // ambient coefficient
+    float kd = 0.75f;                  // diffuse coefficient
+    const Texture* texture = nullptr;  // base colour texture (TexturedShader only)
+};
+
+// Local light prepared for shading - view space, with the falloff and cone terms precomputed
+struct LightView {
+    float px, py, pz;       // position
+    float dx, dy, dz;       // spot direction (unit)
+    float r, g, b;          // colour
+    float radius;           // range
+    float invRadius2;       // 1 / range^2
+    float coneScale;        // cone = clamp(cos * coneScale + coneOffset, 0, 1)
+    float coneOffset;       // (scale 0, offset 1 for point lights)
+
+    // Build from a world space light
+    // Input Variables:
+    // - l: Light to convert
+    // - view: Camera (world to view) matrix
+    static LightView make(const LocalLight& l, const matrix& view) {
+        LightView o;
+        vec4 p = view * l.position;
+        vec4 d = view * l.direction;
+        d.normalise();
+        o.px = p[0]; o.py = p[1]; o.pz = p[2];
+        o.dx = d[0]; o.dy = d[1]; o.dz = d[2];
+        o.r = l.L[colour::RED]; o.g = l.L[colour::GREEN]; o.b = l.L[colour::BLUE];
+        o.radius = l.radius;
+        o.invRadius2 = 1.0f / (l.radius * l.radius);
+        if (l.type == LightType::Spot) {
+            o.coneScale = 1.0f / std::max(l.cosInner - l.cosOuter, 0.0001f);
+            o.coneOffset = -l.cosOuter * o.coneScale;
+        }
+        else {
+            o.coneScale = 0.0f;
+            o.coneOffset = 1.0f;
+        }
+        return o;
+    }
+};
+
+// Everything a shader needs besides the triangle itself
+struct ShadeContext {
+    Light sun;                                // directional light (view space, normalised)
+    const LightView* lights = nullptr;        // all local lights for the frame
+    unsigned int allLightCount = 0;
+    const unsigned int* tileLights = nullptr; // lights touching the current tile
+    unsigned int tileLightCount = 0;
+
+    // screen (x, y, ndc z) -> view space: d = zA / (z + zB), view = ((x*kx+bx)*d, (y*ky+by)*d, -d)
+    float kx = 0.f, bx = 0.f, ky = 0.f, by = 0.f, zA = 0.f, zB = 0.f;
+
+    // Set up the screen to view space reconstruction from the projection
+    // Input Variables:
+    // - proj: Perspective matrix (as built by matrix::makePerspective)
+    // - w, h: Canvas size in pixels
+    void setProjection(matrix& proj, float w, float h) {
+        kx = 2.0f / (w * proj(0, 0));
+        bx = -1.0f / proj(0, 0);
+        ky = -2.0f / (h * proj(1, 1));
+        by = 1.0f / proj(1, 1);
+        zA = proj(2, 3);
+        zB = proj(2, 2);
+    }
+
+    // Reconstruct a view space position from a screen space vertex
+    vec4 unproject(const vec4& s) const {
+        float d = zA / (s[2] + zB);
+        return vec4((s[0] * kx + bx) * d, (s[1] * ky + by) * d, -d, 1.0f);
+    }
+};
+
+// Smooth distance falloff used by all local lights
+inline float lightFalloff(float d2, float invRadius2) {
+    float f = std::max(1.0f - d2 * invRadius2, 0.0f);
+    return f * f;
+}
+
+// Lambert + ambient for one point using every light in the context (geometry stage shaders)
+// Input Variables:
+// - c: Surface colour
+// - n: Unit normal (view space)
+// - pos: View space position
+// - ctx: Lights for the frame
+// - mat: Ambient and diffuse lighting coefficients
+// Returns the lit colour.
+inline colour shadeVertex(colour c, const vec4& n, const vec4& pos, const ShadeContext& ctx, const Material& mat) {
+    c.clampColour();
+    const Light& L = ctx.sun;
+    float dot = std::max(vec4::dot(L.omega_i, n), 0.0f);
+    colour lit = L.L * dot;
+    for (unsigned int i = 0; i < ctx.allLightCount; i++) {
+        const LightView& l = ctx.lights[i];
+        vec4 toL(l.px - pos[0], l.py - pos[1], l.pz - pos[2], 0.0f);
+        float d2 = vec4::dot(toL, toL);
+        if (d2 >= l.radius * l.radius || d2 <= 0.0f) continue;
+        float inv = 1.0f / std::sqrt(d2);
+        float ndl = std::max(vec4::dot(n, toL) * inv, 0.0f);
+        float cone = std::clamp(-(toL[0] * l.dx + toL[1] * l.dy + toL[2] * l.dz) * inv * l.coneScale + l.coneOffset, 0.0f, 1.0f);
+        float s = ndl * lightFalloff(d2, l.invRadius2) * cone;
+        lit = lit + colour(l.r, l.g, l.b) * s;
+    }
+    return (c * mat.kd) * lit + (L.ambient * mat.ka);
+}
+
+// Interpolates three broadcast values with barycentrics (same weight order as triangle::interpolate)
+inline __m128 lerp3(__m128 a0, __m128 a1, __m128 a2, __m128 alpha, __m128 beta, __m128 gamma) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, beta), _mm_mul_ps(a1, gamma)), _mm_mul_ps(a2, alpha));
+}
+
+// No lighting - vertex colours are interpolated as they are
+struct UnlitShader {
+    static void geometry(Vertex (&v)[3], const ShadeContext& ctx, const Material& mat) {}
+
+    struct Pixel {
+        colour4 c0, c1, c2;
+
+        Pixel(const Vertex* v, const ShadeContext& ctx, const Material& mat) : c0(v[0].rgb), c1(v[1].rgb), c2(v[2].rgb) {}
+
+        colour4 shade(__m128 alpha, __m128 beta, __m128 gamma, __m128 px, __m128 py, __m128 depth) const {
+            return c0 * beta + c1 * gamma + c2 * alpha;
+        }
+    };
+};
+
+// One lit colour per triangle (average vertex normal, lit at the centroid), computed in the geometry stage
+struct FlatShader {
+    static void geometry(Vertex (&v)[3], const ShadeContext& ctx, const Material& mat) {
+        vec4 n = v[0].normal + v[1].normal + v[2].normal;
+        n.normalise();
+        colour c = (v[0].rgb + v[1].rgb + v[2].rgb) * (1.0f / 3.0f);
+        vec4 pos;
+        if (ctx.allLightCount > 0)
+            pos = (ctx.unproject(v[0].p) + ctx.unproject(v[1].p) + ctx.unproject(v[2].p)) * (1.0f / 3.0f);
+        c = shadeVertex(c, n, pos, ctx, mat);
+        v[0].rgb = c;
+        v[1].rgb = c;
+        v[2].rgb = c;
+    }
+
+    struct Pixel {
+        colour4 c;
+
+        Pixel(const Vertex* v, const ShadeContext& ctx, const Material& mat) : c(v[0].rgb) {}
+
+        colour4 shade(__m128 alpha, __m128 beta, __m128 gamma, __m128 px, __m128 py, __m128 depth) const {
+            return c;
+        }
+    };
+};
+
+// Lighting per vertex in the geometry stage, lit colours interpolated per pixel
+struct GouraudShader {
+    static void geometry(Vertex (&v)[3], const ShadeContext& ctx, const Material& mat) {
+        for (unsigned int k = 0; k < 3; k++) {
+            vec4 pos;
+            if (ctx.allLightCount > 0) pos = ctx.unproject(v[k].p);
+            v[k].rgb = shadeVertex(v[k].rgb, v[k].normal, pos, ctx, mat);
+        }
+    }
+
+    using Pixel = UnlitShader::Pixel;
+};
+
+// Per-pixel lighting - colour and normal interpolated, normal renormalised, Lambert + ambient,
+// plus every local light in the tile's culled list
+struct PhongShader {
+    static void geometry(Vertex (&v)[3], const ShadeContext& ctx, const Material& mat) {}
+
+    struct Pixel {
+        colour4 c0, c1, c2;
+        __m128 n0x, n0y, n0z, n1x, n1y, n1z, n2x, n2y, n2z;
+        __m128 lx, ly, lz;
+        colour4 lightCol;
+        colour4 ambient;
+        __m128 vKd;
+        const ShadeContext& ctx;
+
+        Pixel(const Vertex* v, const ShadeContext& _ctx, const Material& mat)
+            : c0(v[0].rgb), c1(v[1].rgb), c2(v[2].rgb), lightCol(_ctx.sun.L), ambient(_ctx.sun.ambient * mat.ka), ctx(_ctx) {
+            n0x = _mm_set1_ps(v[0].normal[0]); n0y = _mm_set1_ps(v[0].normal[1]); n0z = _mm_set1_ps(v[0].normal[2]);
+            n1x = _mm_set1_ps(v[1].normal[0]); n1y = _mm_set1_ps(v[1].normal[1]); n1z = _mm_set1_ps(v[1].normal[2]);
+            n2x = _mm_set1_ps(v[2].normal[0]); n2y = _mm_set1_ps(v[2].normal[1]); n2z = _mm_set1_ps(v[2].normal[2]);
+            lx = _mm_set1_ps(ctx.sun.omega_i[0]); ly = _mm_set1_ps(ctx.sun.omega_i[1]); lz = _mm_set1_ps(ctx.sun.omega_i[2]);
+            vKd = _mm_set1_ps(mat.kd);
+        }
+
+        colour4 shade(__m128 alpha, __m128 beta, __m128 gamma, __m128 px, __m128 py, __m128 depth) const {
+            return light(baseColour(alpha, beta, gamma), alpha, beta, gamma, px, py, depth);
+        }
+
+        // Interpolated vertex colour, clamped to 0-1
+        colour4 baseColour(__m128 alpha, __m128 beta, __m128 gamma) const {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            colour4 c = c0 * beta + c1 * gamma + c2 * alpha;
+            c.r = _mm_min_ps(_mm_max_ps(c.r, zero), one);
+            c.g = _mm_min_ps(_mm_max_ps(c.g, zero), one);
+            c.b = _mm_min_ps(_mm_max_ps(c.b, zero), one);
+            return c;
+        }
+
+        // Light a surface colour with the interpolated normal (sun + the tile's local lights)
+        colour4 light(const colour4& c, __m128 alpha, __m128 beta, __m128 gamma, __m128 px, __m128 py, __m128 depth) const {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+
+            //interpolate normal
+            __m128 nx = lerp3(n0x, n1x, n2x, alpha, beta, gamma);
+            __m128 ny = lerp3(n0y, n1y, n2y, alpha, beta, gamma);
+            __m128 nz = lerp3(n0z, n1z, n2z, alpha, beta, gamma);
+
+            //normalise - rsqrt plus one newton step
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+            __m128 rs = _mm_rsqrt_ps(len2);
+            rs = _mm_mul_ps(rs, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), len2), _mm_mul_ps(rs, rs))));
+
+            //lambert (sun)
+            __m128 dot = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, nx), _mm_mul_ps(ly, ny)), _mm_mul_ps(lz, nz)), rs);
+            dot = _mm_max_ps(dot, zero);
+            colour4 lit = lightCol * dot;
+
+            //local lights culled for this tile
+            if (ctx.tileLightCount > 0) {
+                nx = _mm_mul_ps(nx, rs);
+                ny = _mm_mul_ps(ny, rs);
+                nz = _mm_mul_ps(nz, rs);
+
+                //view space position of each pixel
+                __m128 d = _mm_div_ps(_mm_set1_ps(ctx.zA), _mm_add_ps(depth, _mm_set1_ps(ctx.zB)));
+                __m128 vx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(ctx.kx)), _mm_set1_ps(ctx.bx)), d);
+                __m128 vy = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(py, _mm_set1_ps(ctx.ky)), _mm_set1_ps(ctx.by)), d);
+                __m128 vz = _mm_sub_ps(zero, d);
+
+                for (unsigned int i = 0; i < ctx.tileLightCount; i++) {
+                    const LightView& l = ctx.lights[ctx.tileLights[i]];
+                    __m128 tx = _mm_sub_ps(_mm_set1_ps(l.px), vx);
+                    __m128 ty = _mm_sub_ps(_mm_set1_ps(l.py), vy);
+                    __m128 tz = _mm_sub_ps(_mm_set1_ps(l.pz), vz);
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz));
+                    d2 = _mm_max_ps(d2, _mm_set1_ps(1e-8f));
+                    __m128 inv = _mm_rsqrt_ps(d2);
+
+                    //n.l
+                    __m128 ndl = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, tx), _mm_mul_ps(ny, ty)), _mm_mul_ps(nz, tz)), inv);
+                    ndl = _mm_max_ps(ndl, zero);
+
+                    //falloff
+                    __m128 f = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(d2, _mm_set1_ps(l.invRadius2))), zero);
+                    f = _mm_mul_ps(f, f);
+
+                    //spot cone (always 1 for point lights)
+                    __m128 cosA = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, _mm_set1_ps(l.dx)), _mm_mul_ps(ty, _mm_set1_ps(l.dy))), _mm_mul_ps(tz, _mm_set1_ps(l.dz))), inv);
+                    __m128 cone = _mm_sub_ps(_mm_set1_ps(l.coneOffset), _mm_mul_ps(cosA, _mm_set1_ps(l.coneScale)));
+                    cone = _mm_min_ps(_mm_max_ps(cone, zero), one);
+
+                    __m128 s = _mm_mul_ps(_mm_mul_ps(ndl, f), cone);
+                    lit = lit + colour4(_mm_set1_ps(l.r), _mm_set1_ps(l.g), _mm_set1_ps(l.b)) * s;
+                }
+            }
+            return (c * vKd) * lit + ambient;
+        }
+    };
+};
+
+// Phong lighting with the vertex colour modulated by a mip-mapped texture.
+// UVs are interpolated perspective correct (u/w, v/w and 1/w are linear in screen space).
+// The mip level comes from UV derivatives taken across each 2x2 pixel quad: the four pixels of a
+// group are two quads side by side, both quads are evaluated at their top-left, right and lower
+// neighbours (quad rows start on even y), so every pixel of a quad reads the same level.
+struct TexturedShader {
+    static void geometry(Vertex (&v)[3], const ShadeContext& ctx, const Material& mat) {}
+
+    struct Pixel : PhongShader::Pixel {
+        const Texture& tex;
+        __m128 ox, oy;                           // screen space origin (vertex 0)
+        __m128 uw, uwx, uwy, vw, vwx, vwy, qw, qwx, qwy; // value at origin and x / y gradients
+        __m128 texSize;
+        __m128i maxLevel;
+
+        Pixel(const Vertex* v, const ShadeContext& _ctx, const Material& mat)
+            : PhongShader::Pixel(v, _ctx, mat), tex(*mat.texture) {
+            //screen space plane of each attribute through the three vertices
+            float x1 = v[1].p[0] - v[0].p[0], y1 = v[1].p[1] - v[0].p[1];
+            float x2 = v[2].p[0] - v[0].p[0], y2 = v[2].p[1] - v[0].p[1];
+            float det = x1 * y2 - x2 * y1;
+            float invDet = std::fabs(det) > 1e-12f ? 1.0f / det : 0.0f;
+            auto plane = [&](float f0, float f1, float f2, __m128& f, __m128& fx, __m128& fy) {
+                float d1 = f1 - f0, d2 = f2 - f0;
+                f = _mm_set1_ps(f0);
+                fx = _mm_set1_ps((d1 * y2 - d2 * y1) * invDet);
+                fy = _mm_set1_ps((d2 * x1 - d1 * x2) * invDet);
+            };
+            //p[3] holds 1/w after the geometry stage
+            plane(v[0].uv[0] * v[0].p[3], v[1].uv[0] * v[1].p[3], v[2].uv[0] * v[2].p[3], uw, uwx, uwy);
+            plane(v[0].uv[1] * v[0].p[3], v[1].uv[1] * v[1].p[3], v[2].uv[1] * v[2].p[3], vw, vwx, vwy);
+            plane(v[0].p[3], v[1].p[3], v[2].p[3], qw, qwx, qwy);
+            ox = _mm_set1_ps(v[0].p[0]);
+            oy = _mm_set1_ps(v[0].p[1]);
+            texSize = _mm_set1_ps((float)tex.size);
+            maxLevel = _mm_set1_epi32((int)tex.levels - 1);
+        }
+
+        // Perspective correct UV at screen positions (x, y)
+        void uvAt(__m128 x, __m128 y, __m128& u, __m128& v) const {
+            __m128 dx = _mm_sub_ps(x, ox), dy = _mm_sub_ps(y, oy);
+            __m128 q = _mm_add_ps(qw, _mm_add_ps(_mm_mul_ps(qwx, dx), _mm_mul_ps(qwy, dy)));
+            __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), q);
+            u = _mm_mul_ps(_mm_add_ps(uw, _mm_add_ps(_mm_mul_ps(uwx, dx), _mm_mul_ps(uwy, dy))), w);
+            v = _mm_mul_ps(_mm_add_ps(vw, _mm_add_ps(_mm_mul_ps(vwx, dx), _mm_mul_ps(vwy, dy))), w);
+        }
+
+        colour4 shade(__m128 alpha, __m128 beta, __m128 gamma, __m128 px, __m128 py, __m128 depth) const {
+            const __m128 one = _mm_set1_ps(1.0f);
+            __m128 u, v;
+            uvAt(px, py, u, v);
+
+            //quad corners - lanes 0,1 are one quad and lanes 2,3 the next
+            __m128 qx = _mm_shuffle_ps(px, px, _MM_SHUFFLE(2, 2, 0, 0));
+            __m128 qy = _mm_set1_ps((float)(_mm_cvttss_si32(py) & ~1));
+            __m128 u00, v00, u10, v10, u01, v01;
+            uvAt(qx, qy, u00, v00);
+            uvAt(_mm_add_ps(qx, one), qy, u10, v10);
+            uvAt(qx, _mm_add_ps(qy, one), u01, v01);
+
+            //largest squared footprint in level 0 texels
+            __m128 dudx = _mm_mul_ps(_mm_sub_ps(u10, u00), texSize), dvdx = _mm_mul_ps(_mm_sub_ps(v10, v00), texSize);
+            __m128 dudy = _mm_mul_ps(_mm_sub_ps(u01, u00), texSize), dvdy = _mm_mul_ps(_mm_sub_ps(v01, v00), texSize);
+            __m128 rho2 = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dudx, dudx), _mm_mul_ps(dvdx, dvdx)),
+                _mm_add_ps(_mm_mul_ps(dudy, dudy), _mm_mul_ps(dvdy, dvdy)));
+
+            //lod = round(log2(rho)) = (floor(log2(rho^2)) + 1) / 2, log2 from the float exponent
+            __m128i e = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(rho2), 23), _mm_set1_epi32(127));
+            __m128i lod = _mm_srai_epi32(_mm_add_epi32(e, _mm_set1_epi32(1)), 1);
+            lod = _mm_and_si128(lod, _mm_cmpgt_epi32(lod, _mm_setzero_si128()));
+            __m128i over = _mm_cmpgt_epi32(lod, maxLevel);
+            lod = _mm_or_si128(_mm_and_si128(over, maxLevel), _mm_andnot_si128(over, lod));
+
+            colour4 c = baseColour(alpha, beta, gamma) * tex.sample(u, v, lod);
+            return light(c, alpha, beta, gamma, px, py, depth);
+        }
+    };
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+
+// Pipeline statistics.
+// Every worker counts into its own copy (plain integers, padded apart so workers never share a cache
+// line); the pipeline adds them up once per frame. The raster loops count into locals and add them
+// here once per triangle, so the pixel loop only gains a few register adds.
+
+// Geometry stage (per meshlet work item)
+struct GeomStats {
+    unsigned long long meshlets = 0;        // meshlets tested
+    unsigned long long meshletsCulled = 0;  // skipped by the frustum or backface cone test
+    unsigned long long triangles = 0;       // triangles submitted (every triangle of every meshlet)
+    unsigned long long clipped = 0;         // dropped by the depth range test
+    unsigned long long emitted = 0;         // passed on to binning
+
+    void add(const GeomStats& o) {
+        meshlets += o.meshlets;
+        meshletsCulled += o.meshletsCulled;
+        triangles += o.triangles;
+        clipped += o.clipped;
+        emitted += o.emitted;
+    }
+};
+
+// Raster stage (per bin)
+struct RasterStats {
+    unsigned long long triangles = 0;     // triangle draws (one per raster task - bin or strip of a split bin)
+    unsigned long long rejected = 0;      // back facing, degenerate or outside the bin
+    unsigned long long hizCulled = 0;     // 8x8 micro tiles skipped by the HiZ test
+    unsigned long long tested = 0;        // pixels inside the triangle that were depth tested
+    unsigned long long passed = 0;        // pixels that passed the depth test (written)
+    unsigned long long shaded = 0;        // shader lanes run (4 per 2x2 or 1x4 group)
+    unsigned int* overdraw = nullptr;     // per pixel write count for the debug view (nullptr = off)
+    unsigned int overdrawPitch = 0;       // row length of overdraw in pixels
+
+    void add(const RasterStats& o) {
+        triangles += o.triangles;
+        rejected += o.rejected;
+        hizCulled += o.hizCulled;
+        tested += o.tested;
+        passed += o.passed;
+        shaded += o.shaded;
+    }
+
+    // Number of set bits in a 4 lane movemask
+    static unsigned int lanes(int mask) {
+        static constexpr unsigned char bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+        return bits[mask & 15];
+    }
+};
+
+// Whole frame (or the average over several frames)
+struct PipelineStats {
+    GeomStats geom;
+    unsigned long long meshes = 0;      // meshes submitted
+    unsigned long long transformed = 0; // meshes whose view and projection matrices were recomputed (the rest were cached)
+    unsigned long long binRefs = 0;     // triangle - bin pairs written by binning
+    unsigned long long binsUsed = 0;    // bins with at least one triangle
+    unsigned long long bins = 0;        // bins in the grid
+    RasterStats raster;
+
+    void add(const PipelineStats& o) {
+        geom.add(o.geom);
+        meshes += o.meshes;
+        transformed += o.transformed;
+        binRefs += o.binRefs;
+        binsUsed += o.binsUsed;
+        bins += o.bins;
+        raster.add(o.raster);
+    }
+
+    // Print the counters divided by frames (per frame averages)
+    void print(int frames) const {
+        double f = std::max(frames, 1);
+        std::cout << "stats (per frame): meshes " << meshes / f << " (transformed " << transformed / f << ")"
+            << " | meshlets " << geom.meshlets / f << " (culled " << geom.meshletsCulled / f << ")"
+            << " | tris " << geom.triangles / f << " clipped " << geom.clipped / f << " binned " << geom.emitted / f
+            << " | bin refs " << binRefs / f << " bins used " << binsUsed / f << "/" << bins / f
+            << " | draws " << raster.triangles / f << " rejected " << raster.rejected / f << " hiz culled " << raster.hizCulled / f
+            << " | fragments tested " << raster.tested / f << " passed " << raster.passed / f << " shaded " << raster.shaded / f;
+        if (raster.tested) std::cout << " (" << 100.0 * raster.passed / raster.tested << "% pass depth)";
+        std::cout << "\n";
+    }
+};
+
+// Worker's counters, one cache line apart from the next worker's
+struct alignas(64) ThreadStats {
+    GeomStats geom;
+    RasterStats raster;
+};
+
+// Heat map colour ramp: black - blue - cyan - green - yellow - red - white
+// Input Variables:
+// - t: 0 - 1 (clamped)
+// Output Variables:
+// - r, g, b: Colour bytes
+inline void heatColour(float t, unsigned char& r, unsigned char& g, unsigned char& b) {
+    static constexpr float ramp[7][3] = { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 }, { 1, 1, 1 } };
+    t = std::min(std::max(t, 0.f), 1.f) * 6.f;
+    int i = std::min((int)t, 5);
+    float f = t - (float)i;
+    r = (unsigned char)((ramp[i][0] + (ramp[i + 1][0] - ramp[i][0]) * f) * 255.f + 0.5f);
+    g = (unsigned char)((ramp[i][1] + (ramp[i + 1][1] - ramp[i][1]) * f) * 255.f + 0.5f);
+    b = (unsigned char)((ramp[i][2] + (ramp[i + 1][2] - ramp[i][2]) * f) * 255.f + 0.5f);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mesh.h"
+#include "meshio.h"
+#include "profiler.h"
+
+// Double buffered list of the meshes to draw.
+// The render thread draws current(), which only changes in flip() - called between frames - so the
+// pipeline workers read it without locks. Other threads submit meshes into the back list; flip()
+// swaps the lists over when something was submitted (and costs one atomic load when nothing was).
+class SceneList {
+public:
+    // Meshes to draw this frame (render thread)
+    std::vector<Mesh*>& current() {
+        return front;
+    }
+
+    // Add a mesh from the next flip() on (any thread)
+    void submit(Mesh* mesh) {
+        std::lock_guard<std::mutex> lock(mutex);
+        back.push_back(mesh);
+        changed.store(true, std::memory_order_release);
+    }
+
+    // Frame boundary (render thread, never while the pipeline is running): publish the submitted meshes
+    // Returns the number of meshes added to current()
+    size_t flip() {
+        if (!changed.load(std::memory_order_acquire)) return 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t before = front.size();
+        front.swap(back);
+        back = front; //submissions for the next flip start from what is published now
+        changed.store(false, std::memory_order_relaxed);
+        return front.size() - before;
+    }
+
+private:
+    std::vector<Mesh*> front;
+    std::vector<Mesh*> back;
+    std::mutex mutex;
+    std::atomic<bool> changed{ false };
+};
+
+// Loads and builds meshes on a small pool of background I/O threads and submits each one to a
+// SceneList when it is ready, so the render loop never waits on a disk read, an OBJ parse or a
+// meshlet build - it picks the new meshes up at its next SceneList::flip().
+// The I/O threads sleep while the queue is empty. The streamer owns the meshes it made; destroy it
+// only after the last frame that draws them (queued jobs that have not started are dropped).
+class AssetStreamer {
+public:
+    // Start the I/O threads
+    // Input Variables:
+    // - _scene: List finished meshes are submitted to
+    // - threads: Number of I/O threads
+    AssetStreamer(SceneList& _scene, unsigned int threads = 2) : scene(_scene) {
+        for (unsigned int i = 0; i < std::max(threads, 1u); i++)
+            pool.emplace_back([this, i]() {
+                Profiler::instance().nameThread("io " + std::to_string(i));
+                ioLoop();
+            });
+    }
+
+    ~AssetStreamer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            queue.clear();
+        }
+        wake.notify_all();
+        for (auto& t : pool) t.join();
+    }
+
+    AssetStreamer(const AssetStreamer&) = delete;
+    AssetStreamer& operator = (const AssetStreamer&) = delete;
+
+    // Queue a model file (OBJ or .mesh, see MeshIO::load)
+    // Input Variables:
+    // - filename: Model file
+    // - setup: Called on the I/O thread once the mesh is loaded, before it is submitted (world matrix,
+    //          shading, texture ...) - may be empty
+    void load(const std::string& filename, std::function<void(Mesh&)> setup = nullptr) {
+        build([filename, setup](Mesh& mesh) {
+            if (!MeshIO::load(filename, mesh)) return false;
+            if (setup) setup(mesh);
+            return true;
+        });
+    }
+
+    // Queue a procedural mesh
+    // Input Variables:
+    // - make: Fills in the mesh on an I/O thread, returns false to drop it
+    void build(std::function<bool(Mesh&)> make) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(make));
+            outstanding++;
+        }
+        wake.notify_one();
+    }
+
+    // Jobs queued or running
+    unsigned int inFlight() const {
+        return outstanding.load();
+    }
+
+    // Jobs that failed (file missing or unreadable, or make returned false)
+    unsigned int failed() const {
+        return failures.load();
+    }
+
+private:
+    SceneList& scene;
+    std::vector<std::thread> pool;
+    std::deque<std::function<bool(Mesh&)>> queue;
+    std::vector<std::unique_ptr<Mesh>> meshes; //everything submitted (owned)
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit = false;
+    std::atomic<unsigned int> outstanding{ 0 };
+    std::atomic<unsigned int> failures{ 0 };
+
+    // I/O thread - take a job, make the mesh (and its meshlets, so the render thread never builds
+    // them), submit it
+    void ioLoop() {
+        while (true) {
+            std::function<bool(Mesh&)> make;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return quit || !queue.empty(); });
+                if (quit) return;
+                make = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            auto mesh = std::make_unique<Mesh>();
+            bool ok;
+            {
+                PROFILE_ZONE("stream mesh");
+                ok = make(*mesh);
+                if (ok && mesh->meshlets.empty()) mesh->buildMeshlets();
+            }
+            if (ok) {
+                Mesh* m = mesh.get();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    meshes.push_back(std::move(mesh));
+                }
+                scene.submit(m);
+            }
+            else failures++;
+            outstanding--;
+        }
+    }
+};
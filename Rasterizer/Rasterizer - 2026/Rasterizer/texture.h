@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <immintrin.h>
+#include "GamesEngineeringBase.h"
+#include "colour.h"
+
+// Mip-mapped texture for the tile rasterizer.
+// Storage is a square power of two mip chain, every level in Morton (Z-order) layout, one packed
+// RGBA8 word per texel (R in the lowest byte, same packing as the canvas).
+// Z-order keeps each 2x2 bilinear footprint (and the texels of neighbouring pixels) in the same
+// cache line most of the time, and the mip level is chosen per 2x2 quad so minified surfaces read
+// a level whose texels are roughly pixel sized instead of striding across level 0.
+class Texture {
+public:
+    static constexpr unsigned int maxLevels = 16;
+
+    unsigned int size = 0;                   // width and height of level 0 (power of two)
+    unsigned int levels = 0;                 // number of mip levels (size 1x1 is the last)
+    unsigned int levelOffset[maxLevels] = {}; // first texel of each level in texels
+    std::vector<unsigned int> texels;         // every level, Morton order
+
+    // Spread the low 16 bits of x so there is a zero bit between each (x = ...b2 b1 b0 -> ...0 b2 0 b1 0 b0)
+    static unsigned int part1By1(unsigned int x) {
+        x &= 0x0000FFFF;
+        x = (x | (x << 8)) & 0x00FF00FF;
+        x = (x | (x << 4)) & 0x0F0F0F0F;
+        x = (x | (x << 2)) & 0x33333333;
+        x = (x | (x << 1)) & 0x55555555;
+        return x;
+    }
+
+    // Four lane version of part1By1
+    static __m128i part1By1(__m128i x) {
+        x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 8)), _mm_set1_epi32(0x00FF00FF));
+        x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 4)), _mm_set1_epi32(0x0F0F0F0F));
+        x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 2)), _mm_set1_epi32(0x33333333));
+        x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 1)), _mm_set1_epi32(0x55555555));
+        return x;
+    }
+
+    // Morton index of texel (x, y) within a level
+    static unsigned int morton(unsigned int x, unsigned int y) {
+        return part1By1(x) | (part1By1(y) << 1);
+    }
+
+    // Build the texture from raw 8 bit pixels (rows top to bottom)
+    // Non square / non power of two images are resampled (bilinear) up to the next power of two square.
+    // Input Variables:
+    // - data: Pixel data, channels bytes per pixel (RGB or RGBA order)
+    // - w, h: Image size
+    // - channels: Bytes per pixel (1, 3 or 4)
+    void create(const unsigned char* data, unsigned int w, unsigned int h, unsigned int channels) {
+        unsigned int s = 1;
+        while (s < std::max(w, h) && s < (1u << (maxLevels - 1))) s <<= 1;
+        allocate(s);
+
+        //level 0 (resample if needed)
+        for (unsigned int y = 0; y < s; y++) {
+            float fy = std::max((y + 0.5f) * h / s - 0.5f, 0.0f);
+            unsigned int y0 = std::min((unsigned int)fy, h - 1), y1 = std::min(y0 + 1, h - 1);
+            float ty = fy - (float)y0;
+            for (unsigned int x = 0; x < s; x++) {
+                float fx = std::max((x + 0.5f) * w / s - 0.5f, 0.0f);
+                unsigned int x0 = std::min((unsigned int)fx, w - 1), x1 = std::min(x0 + 1, w - 1);
+                float tx = fx - (float)x0;
+                float c[3];
+                for (unsigned int k = 0; k < 3; k++) {
+                    unsigned int ch = channels < 3 ? 0 : k;
+                    float a = data[(y0 * w + x0) * channels + ch] * (1.0f - tx) + data[(y0 * w + x1) * channels + ch] * tx;
+                    float b = data[(y1 * w + x0) * channels + ch] * (1.0f - tx) + data[(y1 * w + x1) * channels + ch] * tx;
+                    c[k] = a * (1.0f - ty) + b * ty + 0.5f;
+                }
+                texels[morton(x, y)] = GamesEngineeringBase::Window::pack((unsigned char)c[0], (unsigned char)c[1], (unsigned char)c[2]);
+            }
+        }
+        buildMips();
+    }
+
+    // Load an image file (anything WIC can decode) into the texture
+    // Input Variables:
+    // - filename: Path of the image
+    // Returns false if the image could not be loaded.
+    bool load(const std::string& filename) {
+        GamesEngineeringBase::Image image;
+        if (!image.load(filename)) return false;
+        create(image.data, image.width, image.height, image.channels);
+        return true;
+    }
+
+    // Procedural checker board (useful for checking filtering without any files)
+    // Input Variables:
+    // - _size: Size of level 0 (rounded up to a power of two)
+    // - squares: Number of squares along each side
+    // - a, b: Colours of the two square types
+    void makeChecker(unsigned int _size, unsigned int squares, const colour& a, const colour& b) {
+        unsigned int s = 1;
+        while (s < _size && s < (1u << (maxLevels - 1))) s <<= 1;
+        allocate(s);
+        unsigned int pa = a.toPacked(), pb = b.toPacked();
+        unsigned int cell = std::max(s / std::max(squares, 1u), 1u);
+        for (unsigned int y = 0; y < s; y++)
+            for (unsigned int x = 0; x < s; x++)
+                texels[morton(x, y)] = (((x / cell) + (y / cell)) & 1) ? pb : pa;
+        buildMips();
+    }
+
+    // Bilinear sample of four pixels, each from its own mip level, coordinates wrap (repeat)
+    // Input Variables:
+    // - u, v: Texture coordinates (0-1 covers the texture once)
+    // - lod: Mip level per lane (already clamped to 0 - levels-1)
+    // Returns the filtered colours (0-1).
+    colour4 sample(__m128 u, __m128 v, __m128i lod) const {
+        //level size per lane: size >> lod, built as float 2^-lod
+        __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127), lod), 23));
+        __m128 dim = _mm_mul_ps(_mm_set1_ps((float)size), scale);
+        __m128i mask = _mm_sub_epi32(_mm_cvttps_epi32(dim), _mm_set1_epi32(1));
+
+        //texel space, centres at .5
+        __m128 tu = _mm_sub_ps(_mm_mul_ps(u, dim), _mm_set1_ps(0.5f));
+        __m128 tv = _mm_sub_ps(_mm_mul_ps(v, dim), _mm_set1_ps(0.5f));
+        __m128 fu = floorPs(tu), fv = floorPs(tv);
+        __m128 wu = _mm_sub_ps(tu, fu), wv = _mm_sub_ps(tv, fv);
+
+        //wrap with the level mask (two's complement keeps negative coordinates repeating)
+        __m128i x0 = _mm_and_si128(_mm_cvttps_epi32(fu), mask);
+        __m128i y0 = _mm_and_si128(_mm_cvttps_epi32(fv), mask);
+        __m128i x1 = _mm_and_si128(_mm_add_epi32(x0, _mm_set1_epi32(1)), mask);
+        __m128i y1 = _mm_and_si128(_mm_add_epi32(y0, _mm_set1_epi32(1)), mask);
+        __m128i mx0 = part1By1(x0), mx1 = part1By1(x1);
+        __m128i my0 = _mm_slli_epi32(part1By1(y0), 1), my1 = _mm_slli_epi32(part1By1(y1), 1);
+
+        //gather (no gather instruction in SSE2)
+        alignas(16) unsigned int l[4], i00[4], i10[4], i01[4], i11[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(l), lod);
+        _mm_store_si128(reinterpret_cast<__m128i*>(i00), _mm_or_si128(mx0, my0));
+        _mm_store_si128(reinterpret_cast<__m128i*>(i10), _mm_or_si128(mx1, my0));
+        _mm_store_si128(reinterpret_cast<__m128i*>(i01), _mm_or_si128(mx0, my1));
+        _mm_store_si128(reinterpret_cast<__m128i*>(i11), _mm_or_si128(mx1, my1));
+        alignas(16) unsigned int t00[4], t10[4], t01[4], t11[4];
+        for (unsigned int k = 0; k < 4; k++) {
+            const unsigned int* level = texels.data() + levelOffset[l[k]];
+            t00[k] = level[i00[k]];
+            t10[k] = level[i10[k]];
+            t01[k] = level[i01[k]];
+            t11[k] = level[i11[k]];
+        }
+
+        colour4 c00 = unpack(_mm_load_si128(reinterpret_cast<const __m128i*>(t00)));
+        colour4 c10 = unpack(_mm_load_si128(reinterpret_cast<const __m128i*>(t10)));
+        colour4 c01 = unpack(_mm_load_si128(reinterpret_cast<const __m128i*>(t01)));
+        colour4 c11 = unpack(_mm_load_si128(reinterpret_cast<const __m128i*>(t11)));
+        __m128 iu = _mm_sub_ps(_mm_set1_ps(1.0f), wu), iv = _mm_sub_ps(_mm_set1_ps(1.0f), wv);
+        return (c00 * iu + c10 * wu) * iv + (c01 * iu + c11 * wu) * wv;
+    }
+
+    // Unpack four RGBA8 words to 0-1 floats
+    static colour4 unpack(__m128i p) {
+        const __m128i byteMask = _mm_set1_epi32(0xFF);
+        const __m128 inv = _mm_set1_ps(1.0f / 255.0f);
+        return colour4(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(p, byteMask)), inv),
+            _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), byteMask)), inv),
+            _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), byteMask)), inv));
+    }
+
+private:
+    // floor for SSE2 (no _mm_floor_ps before SSE4.1), fine for |x| < 2^31
+    static __m128 floorPs(__m128 x) {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+    }
+
+    // Size the mip chain for a level 0 of s x s
+    void allocate(unsigned int s) {
+        size = s;
+        levels = 0;
+        unsigned int total = 0;
+        for (unsigned int d = s; d > 0; d >>= 1) {
+            levelOffset[levels++] = total;
+            total += d * d;
+        }
+        texels.assign(total, 0);
+    }
+
+    // Box filter every level from the one above.
+    // In Morton order the 2x2 parents of child i are the four consecutive texels 4i..4i+3.
+    void buildMips() {
+        for (unsigned int l = 1; l < levels; l++) {
+            const unsigned int* src = texels.data() + levelOffset[l - 1];
+            unsigned int* dst = texels.data() + levelOffset[l];
+            unsigned int count = (size >> l) * (size >> l);
+            for (unsigned int i = 0; i < count; i++) {
+                const unsigned int* p = src + i * 4;
+                unsigned int out = 0xFF000000;
+                for (unsigned int shift = 0; shift < 24; shift += 8) {
+                    unsigned int sum = ((p[0] >> shift) & 0xFF) + ((p[1] >> shift) & 0xFF) + ((p[2] >> shift) & 0xFF) + ((p[3] >> shift) & 0xFF);
+                    out |= ((sum + 2) >> 2) << shift;
+                }
+                dst[i] = out;
+            }
+        }
+    }
+};
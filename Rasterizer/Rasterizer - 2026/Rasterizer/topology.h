@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Logical processors of the machine: which physical core each belongs to, whether it is an extra
+// SMT (hyper-thread) sibling of that core, and whether the core is an efficiency core of a hybrid CPU.
+// Windows reads GetLogicalProcessorInformationEx, Linux reads /sys/devices/system/cpu. Anything
+// else (or a failed read) falls back to hardware_concurrency cores with no SMT and no E-cores.
+class CpuTopology {
+public:
+    struct Cpu {
+        int id = 0;              // logical processor number (Windows: group * 64 + bit)
+        int core = 0;            // physical core index (unique across packages)
+        bool sibling = false;    // not the first logical processor of its core
+        bool efficiency = false; // E-core of a hybrid CPU
+    };
+
+    std::vector<Cpu> cpus;
+
+    // Read the topology of this machine
+    static CpuTopology detect() {
+        CpuTopology t;
+#if defined(_WIN32)
+        t.detectWindows();
+#elif defined(__linux__)
+        t.detectLinux();
+#endif
+        if (t.cpus.empty()) {
+            unsigned int n = std::max(std::thread::hardware_concurrency(), 1u);
+            for (unsigned int i = 0; i < n; i++)
+                t.cpus.push_back({ (int)i, (int)i, false, false });
+        }
+        return t;
+    }
+
+    // Number of physical cores (optionally only performance cores)
+    unsigned int physicalCores(bool performanceOnly = false) const {
+        unsigned int n = 0;
+        for (const Cpu& c : cpus)
+            if (!c.sibling && (!performanceOnly || !c.efficiency)) n++;
+        return n;
+    }
+
+    // True if the CPU mixes performance and efficiency cores
+    bool hybrid() const {
+        return std::any_of(cpus.begin(), cpus.end(), [](const Cpu& c) { return c.efficiency; });
+    }
+
+    // Logical processors in the order workers should use them: one thread of every performance core,
+    // then the efficiency cores, then the SMT siblings (they share a core's SIMD units with a worker
+    // that is already there, so they add the least)
+    std::vector<int> preferredOrder() const {
+        std::vector<int> order;
+        for (int pass = 0; pass < 3; pass++)
+            for (const Cpu& c : cpus) {
+                int kind = c.sibling ? 2 : (c.efficiency ? 1 : 0);
+                if (kind == pass) order.push_back(c.id);
+            }
+        return order;
+    }
+
+private:
+#if defined(_WIN32)
+    void detectWindows() {
+        DWORD size = 0;
+        GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &size);
+        if (size == 0) return;
+        std::vector<unsigned char> buffer(size);
+        auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+        if (!GetLogicalProcessorInformationEx(RelationProcessorCore, info, &size)) return;
+
+        //efficiency class - higher is faster, hybrid parts report more than one class
+        BYTE best = 0;
+        for (DWORD offset = 0; offset < size;) {
+            auto* entry = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+            best = std::max(best, entry->Processor.EfficiencyClass);
+            offset += entry->Size;
+        }
+
+        int core = 0;
+        for (DWORD offset = 0; offset < size; core++) {
+            auto* entry = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+            bool first = true;
+            for (WORD g = 0; g < entry->Processor.GroupCount; g++) {
+                const GROUP_AFFINITY& ga = entry->Processor.GroupMask[g];
+                for (int bit = 0; bit < 64; bit++) {
+                    if (!(ga.Mask & (KAFFINITY(1) << bit))) continue;
+                    cpus.push_back({ ga.Group * 64 + bit, core, !first, entry->Processor.EfficiencyClass < best });
+                    first = false;
+                }
+            }
+            offset += entry->Size;
+        }
+    }
+#elif defined(__linux__)
+    // Parse a kernel cpu list ("0-3,8,10-11")
+    static std::vector<int> parseList(const std::string& s) {
+        std::vector<int> out;
+        size_t i = 0;
+        while (i < s.size()) {
+            if (s[i] < '0' || s[i] > '9') {
+                i++;
+                continue;
+            }
+            size_t end;
+            int a = std::stoi(s.substr(i), &end);
+            i += end;
+            int b = a;
+            if (i < s.size() && s[i] == '-') {
+                i++;
+                b = std::stoi(s.substr(i), &end);
+                i += end;
+            }
+            for (int c = a; c <= b; c++) out.push_back(c);
+        }
+        return out;
+    }
+
+    static std::string readLine(const std::string& path) {
+        std::ifstream f(path);
+        std::string line;
+        std::getline(f, line);
+        return line;
+    }
+
+    void detectLinux() {
+        const std::string base = "/sys/devices/system/cpu/";
+        std::vector<int> online = parseList(readLine(base + "online"));
+
+        //intel hybrid lists its E-cores under the cpu_atom PMU, other hybrids (arm) report a lower cpu_capacity
+        std::vector<int> atoms = parseList(readLine("/sys/bus/event_source/devices/cpu_atom/cpus"));
+        int maxCapacity = 0;
+        std::vector<int> capacity(online.empty() ? 0 : *std::max_element(online.begin(), online.end()) + 1, 0);
+        for (int id : online) {
+            std::string cap = readLine(base + "cpu" + std::to_string(id) + "/cpu_capacity");
+            if (!cap.empty()) capacity[id] = std::stoi(cap);
+            maxCapacity = std::max(maxCapacity, capacity[id]);
+        }
+
+        std::vector<std::pair<int, int>> cores; //(package, core_id) -> index
+        for (int id : online) {
+            std::string topo = base + "cpu" + std::to_string(id) + "/topology/";
+            std::string pkg = readLine(topo + "physical_package_id"), cid = readLine(topo + "core_id");
+            std::vector<int> siblings = parseList(readLine(topo + "thread_siblings_list"));
+            std::pair<int, int> key(pkg.empty() ? 0 : std::stoi(pkg), cid.empty() ? id : std::stoi(cid));
+            auto it = std::find(cores.begin(), cores.end(), key);
+            int core = (int)(it - cores.begin());
+            if (it == cores.end()) cores.push_back(key);
+
+            Cpu c;
+            c.id = id;
+            c.core = core;
+            c.sibling = !siblings.empty() && siblings.front() != id;
+            c.efficiency = std::find(atoms.begin(), atoms.end(), id) != atoms.end() || (capacity[id] > 0 && capacity[id] < maxCapacity);
+            cpus.push_back(c);
+        }
+    }
+#endif
+};
+
+// How the pipeline's scheduler uses the machine
+struct ThreadConfig {
+    unsigned int workers = 0;     // workers running tasks, including the main thread if it joins (0 = auto)
+    bool mainThreadJoins = true;  // the thread calling run() works too (otherwise it only waits)
+    bool pin = false;             // give each worker its own logical processor
+    std::vector<int> cpus;        // processors to pin to, in worker order (empty = topology preferred order)
+
+    // Sensible settings for this machine: one worker per physical core (performance and efficiency
+    // cores, no SMT siblings), main thread included, not pinned
+    static ThreadConfig defaults(const CpuTopology& topology) {
+        ThreadConfig c;
+        c.workers = std::max(topology.physicalCores(), 1u);
+        return c;
+    }
+
+    // Fill in anything left on auto
+    void resolve(const CpuTopology& topology) {
+        if (workers == 0) workers = defaults(topology).workers;
+        if (pin && cpus.empty()) cpus = topology.preferredOrder();
+    }
+};
+
+// Pin the calling thread to one logical processor (ids from CpuTopology). Returns false if it failed.
+inline bool pinThread(int cpu) {
+#if defined(_WIN32)
+    GROUP_AFFINITY ga = {};
+    ga.Group = (WORD)(cpu / 64);
+    ga.Mask = KAFFINITY(1) << (cpu % 64);
+    return SetThreadGroupAffinity(GetCurrentThread(), &ga, nullptr) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Affinity of a thread, saved before pinning it so it can be put back afterwards
+struct ThreadAffinity {
+#if defined(_WIN32)
+    GROUP_AFFINITY mask = {};
+#elif defined(__linux__)
+    cpu_set_t mask;
+#endif
+    bool saved = false;
+
+    // Affinity of the calling thread (saved stays false if it could not be read)
+    static ThreadAffinity current() {
+        ThreadAffinity a;
+#if defined(_WIN32)
+        a.saved = GetThreadGroupAffinity(GetCurrentThread(), &a.mask) != 0;
+#elif defined(__linux__)
+        CPU_ZERO(&a.mask);
+        a.saved = pthread_getaffinity_np(pthread_self(), sizeof(a.mask), &a.mask) == 0;
+#endif
+        return a;
+    }
+
+    // Give the calling thread this affinity again. Returns false if nothing was saved or it failed.
+    bool restore() const {
+        if (!saved) return false;
+#if defined(_WIN32)
+        return SetThreadGroupAffinity(GetCurrentThread(), &mask, nullptr) != 0;
+#elif defined(__linux__)
+        return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+        return false;
+#endif
+    }
+};
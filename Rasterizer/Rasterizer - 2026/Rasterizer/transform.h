@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "vec4.h"
+#include "matrix.h"
+#include "dispatch.h"
+
+// Rotation stored as a unit quaternion (x, y, z = axis * sin(angle / 2), w = cos(angle / 2)).
+// Composing two rotations is 16 multiplies instead of a 4x4 matrix product, and renormalising keeps
+// a rotation that is updated every frame from drifting away from a pure rotation.
+class quat {
+public:
+    float x, y, z, w;
+
+    // Constructor - the default is no rotation
+    quat(float _x = 0.f, float _y = 0.f, float _z = 0.f, float _w = 1.f) : x(_x), y(_y), z(_z), w(_w) {}
+
+    // Rotation of aRad radians around a unit length axis
+    static quat fromAxisAngle(const vec4& axis, float aRad) {
+        float s = std::sin(aRad * 0.5f);
+        return quat(axis[0] * s, axis[1] * s, axis[2] * s, std::cos(aRad * 0.5f));
+    }
+
+    // Same rotation as matrix::makeRotateXYZ (X * Y * Z)
+    static quat fromRotateXYZ(float ax, float ay, float az) {
+        float cx = std::cos(ax * 0.5f), sx = std::sin(ax * 0.5f);
+        float cy = std::cos(ay * 0.5f), sy = std::sin(ay * 0.5f);
+        float cz = std::cos(az * 0.5f), sz = std::sin(az * 0.5f);
+        return quat(sx, 0.f, 0.f, cx) * quat(0.f, sy, 0.f, cy) * quat(0.f, 0.f, sz, cz);
+    }
+
+    // Rotation by q followed by this rotation (as matrices: this * q)
+    quat operator * (const quat& q) const {
+        return quat(w * q.x + x * q.w + y * q.z - z * q.y,
+            w * q.y - x * q.z + y * q.w + z * q.x,
+            w * q.z + x * q.y - y * q.x + z * q.w,
+            w * q.w - x * q.x - y * q.y - z * q.z);
+    }
+
+    // Scale back to unit length (call after accumulating many products)
+    void normalise() {
+        float len = std::sqrt(x * x + y * y + z * z + w * w);
+        x /= len;
+        y /= len;
+        z /= len;
+        w /= len;
+    }
+
+    // Rotate the x, y, z part of a vector (w is kept)
+    vec4 rotate(const vec4& v) const {
+        //v + 2w(u x v) + 2u x (u x v), u = (x, y, z)
+        vec4 u(x, y, z, 0.f);
+        vec4 t = vec4::cross(u, v) * 2.f;
+        vec4 r = v + t * w + vec4::cross(u, t);
+        r[3] = v[3];
+        return r;
+    }
+};
+
+// Translation, rotation and uniform scale of an object: world = T * R * S
+struct Transform {
+    vec4 translation = vec4(0.f, 0.f, 0.f, 1.f);
+    quat rotation;
+    float scale = 1.f;
+
+    Transform() = default;
+    Transform(const vec4& t, const quat& r = quat(), float s = 1.f) : translation(t), rotation(r), scale(s) {}
+
+    // Child transform placed inside this one (as matrices: this * child)
+    Transform operator * (const Transform& child) const {
+        vec4 t = rotation.rotate(child.translation) * scale + translation;
+        t[3] = 1.f;
+        quat r = rotation * child.rotation;
+        r.normalise();
+        return Transform(t, r, scale * child.scale);
+    }
+
+    // Apply to a point
+    vec4 apply(const vec4& p) const {
+        vec4 r = rotation.rotate(p) * scale + translation;
+        r[3] = p[3];
+        return r;
+    }
+
+    // The 4x4 world matrix (same kernel as TransformSoA::build, so single and batched results match)
+    matrix toMatrix() const {
+        matrix m;
+        float t[3] = { translation[0], translation[1], translation[2] };
+        SimdKernels::active().buildTRS(&t[0], &t[1], &t[2], &rotation.x, &rotation.y, &rotation.z, &rotation.w, &scale, &m(0, 0), 1);
+        return m;
+    }
+};
+
+// Many transforms stored as SoA streams, turned into world matrices in one vectorised pass
+// (4 or 8 per step, see SimdKernels::buildTRS)
+class TransformSoA {
+public:
+    std::vector<float> tx, ty, tz;      // translation
+    std::vector<float> qx, qy, qz, qw;  // rotation
+    std::vector<float> s;               // uniform scale
+
+    size_t size() const {
+        return tx.size();
+    }
+
+    // Resize (new entries are identity transforms)
+    void resize(size_t n) {
+        tx.resize(n, 0.f); ty.resize(n, 0.f); tz.resize(n, 0.f);
+        qx.resize(n, 0.f); qy.resize(n, 0.f); qz.resize(n, 0.f); qw.resize(n, 1.f);
+        s.resize(n, 1.f);
+    }
+
+    void set(size_t i, const Transform& t) {
+        tx[i] = t.translation[0]; ty[i] = t.translation[1]; tz[i] = t.translation[2];
+        qx[i] = t.rotation.x; qy[i] = t.rotation.y; qz[i] = t.rotation.z; qw[i] = t.rotation.w;
+        s[i] = t.scale;
+    }
+
+    Transform get(size_t i) const {
+        return Transform(vec4(tx[i], ty[i], tz[i]), quat(qx[i], qy[i], qz[i], qw[i]), s[i]);
+    }
+
+    void setRotation(size_t i, const quat& q) {
+        qx[i] = q.x; qy[i] = q.y; qz[i] = q.z; qw[i] = q.w;
+    }
+
+    quat getRotation(size_t i) const {
+        return quat(qx[i], qy[i], qz[i], qw[i]);
+    }
+
+    // Build the world matrices of transforms begin to end - 1 (out[0] is transform begin's)
+    // Input Variables:
+    // - begin, end: Range of transforms
+    // Output Variables:
+    // - out: end - begin matrices
+    void build(size_t begin, size_t end, matrix* out) const {
+        if (end <= begin) return;
+        SimdKernels::active().buildTRS(tx.data() + begin, ty.data() + begin, tz.data() + begin, qx.data() + begin, qy.data() + begin,
+            qz.data() + begin, qw.data() + begin, s.data() + begin, &out[0](0, 0), end - begin);
+    }
+};
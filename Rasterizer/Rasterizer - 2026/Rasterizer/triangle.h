@@ -4,9 +4,13 @@
 #include "colour.h"
 #include "renderer.h"
 #include "light.h"
+#include "shader.h"
+#include "stats.h"
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <climits>
+#include <immintrin.h>
 
 // Simple support class for a 2D vector
 class vec2D {
@@ -37,6 +41,113 @@ public:
     }
 };
 
+// Exact edge functions for the tile rasterizer.
+// Vertices are snapped to a 28.4 fixed point grid (1/16 pixel) and the edge functions are evaluated
+// in 64-bit integers, stepped per 4 pixel group and narrowed to 32 bits for the SIMD compares.
+// Top-left rule: a sample exactly on an edge is inside only for top and left edges, so pixels on an
+// edge shared by two triangles belong to exactly one of them.
+// Edges are in getC order - 0 (v0->v1) weights v2, 1 (v1->v2) weights v0, 2 (v2->v0) weights v1.
+struct FixedEdges {
+    static constexpr int subBits = 4;
+    static constexpr int subPixel = 1 << subBits;
+    static constexpr long long guard = 1ll << 22;  // snapped coordinates are clamped to +-guard (+-262144 pixels)
+    static constexpr int limit = 1 << 29;          // narrowed edge values, far enough out that the sign never changes
+
+    long long x[3], y[3];   // snapped vertices
+    long long ex[3], ey[3]; // edge gradients per fixed point unit (point inside the triangle)
+    int bias[3];            // 0 for top-left edges, -1 otherwise (inside when E + bias >= 0)
+    long long area;         // twice the triangle area in fixed point units (> 0 for visible triangles)
+    float invArea;
+
+    // Per lane offsets of a 4 pixel group
+    struct Lanes {
+        __m128i e[3]; // edge value offset plus bias
+        __m128 b[3];  // barycentric offset
+    };
+
+    // Snap the triangle and build the edge functions
+    // Input Variables:
+    // - v: Screen space vertices
+    // Returns false for back facing or degenerate triangles.
+    bool setup(const Vertex* v) {
+        for (unsigned int i = 0; i < 3; i++) {
+            x[i] = snap(v[i].p[0]);
+            y[i] = snap(v[i].p[1]);
+        }
+        for (unsigned int i = 0; i < 3; i++) {
+            unsigned int j = (i + 1) % 3;
+            ex[i] = y[i] - y[j];
+            ey[i] = x[j] - x[i];
+            bias[i] = (ex[i] > 0 || (ex[i] == 0 && ey[i] > 0)) ? 0 : -1;
+        }
+        area = ex[0] * (x[2] - x[0]) + ey[0] * (y[2] - y[0]);
+        if (area <= 0) return false;
+        invArea = 1.0f / (float)area;
+        return true;
+    }
+
+    // Snap a screen coordinate to the fixed point grid
+    // (round to nearest even, the same as _mm_cvtps_epi32, so MicroBatch snaps identically)
+    static long long snap(float c) {
+        return std::clamp((long long)std::llrint(c * subPixel), -guard, guard);
+    }
+
+    // True if the snapped triangle covers at most 2x2 pixel sample points (see MicroBatch)
+    static bool isMicro(const Vertex* v) {
+        long long minX = guard, minY = guard, maxX = -guard, maxY = -guard;
+        for (unsigned int i = 0; i < 3; i++) {
+            long long sx = snap(v[i].p[0]), sy = snap(v[i].p[1]);
+            minX = std::min(minX, sx); maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy); maxY = std::max(maxY, sy);
+        }
+        //first and last pixel sample point inside the bounds on each axis
+        return (maxX >> subBits) - ((minX + subPixel - 1) >> subBits) <= 1 &&
+            (maxY >> subBits) - ((minY + subPixel - 1) >> subBits) <= 1;
+    }
+
+    // Edge values at pixel (px, py)
+    void at(int px, int py, long long (&e)[3]) const {
+        for (unsigned int i = 0; i < 3; i++)
+            e[i] = ex[i] * ((long long)px * subPixel - x[i]) + ey[i] * ((long long)py * subPixel - y[i]);
+    }
+
+    // Advance edge values by one 4 pixel group / one row
+    void stepX(long long (&e)[3]) const {
+        for (unsigned int i = 0; i < 3; i++) e[i] += ex[i] * (4 * subPixel);
+    }
+    void stepY(long long (&e)[3]) const {
+        for (unsigned int i = 0; i < 3; i++) e[i] += ey[i] * subPixel;
+    }
+
+    // Narrow an edge value to 32 bits (lane/sample offsets added afterwards stay below 2^31)
+    static int narrow(long long e) {
+        return (int)std::clamp(e, (long long)-limit, (long long)limit);
+    }
+
+    Lanes lanes() const {
+        Lanes l;
+        for (unsigned int i = 0; i < 3; i++) {
+            int s = (int)(ex[i] * subPixel);
+            l.e[i] = _mm_set_epi32(3 * s + bias[i], 2 * s + bias[i], s + bias[i], bias[i]);
+            float f = (float)s * invArea;
+            l.b[i] = _mm_set_ps(3.0f * f, 2.0f * f, f, 0.0f);
+        }
+        return l;
+    }
+
+    // Pixels whose sample point can be inside the snapped triangle (end exclusive)
+    // Input Variables:
+    // - pad: Extra pixels on every side (1 for multisampling)
+    void pixelBounds(int pad, int& startX, int& startY, int& endX, int& endY) const {
+        startX = (int)((std::min({ x[0], x[1], x[2] }) + subPixel - 1) >> subBits) - pad;
+        startY = (int)((std::min({ y[0], y[1], y[2] }) + subPixel - 1) >> subBits) - pad;
+        endX = (int)(std::max({ x[0], x[1], x[2] }) >> subBits) + 1 + pad;
+        endY = (int)(std::max({ y[0], y[1], y[2] }) >> subBits) + 1 + pad;
+        startX = std::max(startX, 0);
+        startY = std::max(startY, 0);
+    }
+};
+
 // Class representing a triangle for rendering purposes
 class triangle {
     Vertex v[3];       // Vertices of the triangle
@@ -104,8 +215,11 @@ public:
         // Get the screen-space bounds of the triangle
         getBoundsWindow(renderer.canvas, minV, maxV);
 
-        // Skip very small triangles
-        if (area < 1.f) return;
+        // Skip degenerate triangles
+        if (area <= 0.f) return;
+
+        // Light direction is the same for every pixel so normalise it once
+        L.omega_i.normalise();
 
         // Iterate over the bounding box and check each pixel
         for (int y = (int)(minV.y); y < (int)ceil(maxV.y); y++) {
@@ -119,12 +233,11 @@ public:
                     c.clampColour();
                     float depth = interpolate(beta, gamma, alpha, v[0].p[2], v[1].p[2], v[2].p[2]);
                     vec4 normal = interpolate(beta, gamma, alpha, v[0].normal, v[1].normal, v[2].normal);
-                    normal.normalise();
+                    normal.normaliseFast();
 
                     // Perform Z-buffer test and apply shading
                     if (renderer.zbuffer(x, y) > depth && depth > 0.001f) {
                         // typical shader begin
-                        L.omega_i.normalise();
                         float dot = std::max(vec4::dot(L.omega_i, normal), 0.0f);
                         colour a = (c * kd) * (L.L * dot) + (L.ambient * ka); // using kd instead of ka for ambient
                         // typical shader end
@@ -138,42 +251,309 @@ public:
         }
     }
 
-    void drawClipped(Renderer& renderer, Light& L, float ka, float kd, int tileStartX, int tileStartY, int tileEndX, int tileEndY) {
-        vec2D minV, maxV;
-        getBoundsWindow(renderer.canvas, minV, maxV);
+    // Draw the part of the triangle that lies inside one screen tile, four pixels per step
+    // Coverage uses exact 28.4 fixed point edge functions with the top-left rule, so a pixel on an
+    // edge shared by two triangles is drawn once. Barycentrics for depth/shading are still float.
+    // The tile is walked in 8x8 micro tiles: each is rejected when the triangle misses it or (with
+    // hiz) when the triangle is entirely behind it, and a micro tile the triangle covers completely
+    // pulls its hiz value in to the triangle's farthest depth.
+    // Shader is one of the variants in shader.h and is fixed at compile time
+    // Input Variables:
+    // - renderer: Renderer object for drawing
+    // - ctx: Lights for shading (view space) including the tile's culled light list
+    // - mat: Surface coefficients and texture
+    // - tileStartX, tileStartY, tileEndX, tileEndY: Tile bounds in pixels (tile x bounds must be multiples of 4)
+    // - hiz: Micro tile depths for the renderer's zbuffer (optional)
+    // - stats: Counters to add to (optional)
+    template <typename Shader>
+    void drawClipped(Renderer& renderer, const ShadeContext& ctx, const Material& mat, int tileStartX, int tileStartY, int tileEndX, int tileEndY, HiZ* hiz = nullptr, RasterStats* stats = nullptr) {
+        if (stats) stats->triangles++;
+        FixedEdges edges;
+        if (!edges.setup(v)) {
+            if (stats) stats->rejected++;
+            return;
+        }
 
-        //clip bound box
-        int startX = std::max((int)std::floor(minV.x), tileStartX);
-        int endX = std::min((int)std::ceil(maxV.x), tileEndX);
-        int startY = std::max((int)std::floor(minV.y), tileStartY);
-        int endY = std::min((int)std::ceil(maxV.y), tileEndY);
+        //pixels inside the snapped bounds, clipped to the tile and canvas
+        int startX, startY, endX, endY;
+        edges.pixelBounds(0, startX, startY, endX, endY);
+        startX = std::max(startX, tileStartX);
+        startY = std::max(startY, tileStartY);
+        endX = std::min({ endX, tileEndX, (int)renderer.canvas.getWidth() });
+        endY = std::min({ endY, tileEndY, (int)renderer.canvas.getHeight() });
 
         //skip triangles outside
-        if (endX <= startX || endY <= startY) return;
-        if (area < 1.f) return;
+        if (endX <= startX || endY <= startY) {
+            if (stats) stats->rejected++;
+            return;
+        }
 
-        for (int y = startY; y < endY; y++) {
-            for (int x = startX; x < endX; x++) {
-                float alpha, beta, gamma;
-                if (getCoordinates(vec2D((float)x, (float)y), alpha, beta, gamma)) {
-                    colour c = interpolate(beta, gamma, alpha, v[0].rgb, v[1].rgb, v[2].rgb);
-                    c.clampColour();
-                    float depth = interpolate(beta, gamma, alpha, v[0].p[2], v[1].p[2], v[2].p[2]);
-                    vec4 normal = interpolate(beta, gamma, alpha, v[0].normal, v[1].normal, v[2].normal);
-                    normal.normalise();
+        //per lane edge and barycentric offsets
+        FixedEdges::Lanes lanes = edges.lanes();
 
-                    if (renderer.zbuffer(x, y) > depth && depth > 0.001f) {
-                        L.omega_i.normalise();
-                        float dot = std::max(vec4::dot(L.omega_i, normal), 0.0f);
-                        colour a = (c * kd) * (L.L * dot) + (L.ambient * ka);
+        //depth and shader setup once per triangle
+        const float triMinZ = std::min({ v[0].p[2], v[1].p[2], v[2].p[2] });
+        const float triMaxZ = std::max({ v[0].p[2], v[1].p[2], v[2].p[2] });
+        const __m128 z0 = _mm_set1_ps(v[0].p[2]), z1 = _mm_set1_ps(v[1].p[2]), z2 = _mm_set1_ps(v[2].p[2]);
+        const typename Shader::Pixel shader(v, ctx, mat);
 
-                        unsigned char r, g, b;
-                        a.toRGB(r, g, b);
-                        renderer.canvas.draw(x, y, r, g, b);
-                        renderer.zbuffer(x, y) = depth;
+        const __m128 minDepth = _mm_set1_ps(0.001f);
+        const __m128i outside = _mm_set1_epi32(-1);
+        const __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+
+        //counters for the whole triangle (added to stats at the end)
+        unsigned int tested = 0, passed = 0, shaded = 0, hizCulled = 0;
+        unsigned int* overdraw = stats ? stats->overdraw : nullptr;
+
+        for (int my = startY & ~(HiZ::size - 1); my < endY; my += HiZ::size) {
+            for (int mx = startX & ~(HiZ::size - 1); mx < endX; mx += HiZ::size) {
+                //part of the micro tile inside the clipped bounds
+                int x0 = std::max(mx, startX), x1 = std::min(mx + HiZ::size, endX);
+                int y0 = std::max(my, startY), y1 = std::min(my + HiZ::size, endY);
+
+                //edge values at the corner pixels - the triangle misses the micro tile if one edge
+                //has every corner outside, and covers it if every corner is inside every edge
+                long long c00[3], c10[3], c01[3], c11[3];
+                edges.at(x0, y0, c00);
+                edges.at(x1 - 1, y0, c10);
+                edges.at(x0, y1 - 1, c01);
+                edges.at(x1 - 1, y1 - 1, c11);
+                bool miss = false, covered = true;
+                for (unsigned int i = 0; i < 3; i++) {
+                    long long b = edges.bias[i];
+                    long long lo = std::min({ c00[i], c10[i], c01[i], c11[i] }) + b;
+                    long long hi = std::max({ c00[i], c10[i], c01[i], c11[i] }) + b;
+                    miss |= hi < 0;
+                    covered &= lo >= 0;
+                }
+                if (miss) continue;
+                if (hiz && triMinZ >= hiz->at(mx, my)) {
+                    hizCulled++;
+                    continue;
+                }
+
+                int groupStartX = x0 & ~3;
+                const __m128i vStartX = _mm_set1_epi32(x0);
+                const __m128i vEndX = _mm_set1_epi32(x1);
+                long long rowE[3];
+                edges.at(groupStartX, y0, rowE);
+
+                for (int y = y0; y < y1; y++) {
+                    //packed row (write whole pixel as one word)
+                    unsigned int* row = renderer.canvas.getRow(y);
+                    float* zrow = renderer.zbuffer.row(y);
+                    const __m128 py = _mm_set1_ps((float)y);
+
+                    long long e[3] = { rowE[0], rowE[1], rowE[2] };
+                    for (int x = groupStartX; x < x1; x += 4) {
+                        __m128i xi = _mm_add_epi32(_mm_set1_epi32(x), lane);
+
+                        //inside all three edges (integer) and inside clipped box
+                        __m128i inBox = _mm_andnot_si128(_mm_cmplt_epi32(xi, vStartX), _mm_cmplt_epi32(xi, vEndX));
+                        __m128i in0 = _mm_cmpgt_epi32(_mm_add_epi32(_mm_set1_epi32(FixedEdges::narrow(e[0])), lanes.e[0]), outside);
+                        __m128i in1 = _mm_cmpgt_epi32(_mm_add_epi32(_mm_set1_epi32(FixedEdges::narrow(e[1])), lanes.e[1]), outside);
+                        __m128i in2 = _mm_cmpgt_epi32(_mm_add_epi32(_mm_set1_epi32(FixedEdges::narrow(e[2])), lanes.e[2]), outside);
+                        __m128 inside = _mm_castsi128_ps(_mm_and_si128(_mm_and_si128(in0, in1), _mm_and_si128(in2, inBox)));
+                        int insideMask = _mm_movemask_ps(inside);
+                        if (insideMask == 0) {
+                            edges.stepX(e);
+                            continue;
+                        }
+                        tested += RasterStats::lanes(insideMask);
+
+                        //barycentrics
+                        __m128 alpha = _mm_add_ps(_mm_set1_ps((float)e[0] * edges.invArea), lanes.b[0]);
+                        __m128 beta = _mm_add_ps(_mm_set1_ps((float)e[1] * edges.invArea), lanes.b[1]);
+                        __m128 gamma = _mm_add_ps(_mm_set1_ps((float)e[2] * edges.invArea), lanes.b[2]);
+                        edges.stepX(e);
+
+                        //depth test
+                        __m128 depth = lerp3(z0, z1, z2, alpha, beta, gamma);
+                        __m128 zOld = _mm_load_ps(zrow + x);
+                        __m128 pass = _mm_and_ps(inside, _mm_and_ps(_mm_cmpgt_ps(zOld, depth), _mm_cmpgt_ps(depth, minDepth)));
+                        int passMask = _mm_movemask_ps(pass);
+                        if (passMask == 0) continue;
+                        passed += RasterStats::lanes(passMask);
+                        shaded += 4;
+
+                        //shade
+                        __m128 px = _mm_cvtepi32_ps(xi);
+                        colour4 a = shader.shade(alpha, beta, gamma, px, py, depth);
+
+                        //masked store of 4 pixels and depths
+                        __m128i passi = _mm_castps_si128(pass);
+                        __m128i pixels = a.toPacked();
+                        __m128i old = _mm_load_si128(reinterpret_cast<__m128i*>(row + x));
+                        _mm_store_si128(reinterpret_cast<__m128i*>(row + x), _mm_or_si128(_mm_and_si128(passi, pixels), _mm_andnot_si128(passi, old)));
+                        _mm_store_ps(zrow + x, _mm_or_ps(_mm_and_ps(pass, depth), _mm_andnot_ps(pass, zOld)));
+                        //debug view - count the write (pass lanes are -1)
+                        if (overdraw) {
+                            __m128i* count = reinterpret_cast<__m128i*>(overdraw + (size_t)y * stats->overdrawPitch + x);
+                            _mm_storeu_si128(count, _mm_sub_epi32(_mm_loadu_si128(count), passi));
+                        }
                     }
+                    edges.stepY(rowE);
+                }
+
+                //every pixel of a fully covered micro tile is now at or in front of the triangle's farthest depth
+                //(only the whole micro tile counts, and not when the near plane test could have dropped pixels)
+                if (hiz && covered && triMinZ > 0.001f && x0 == mx && y0 == my && x1 == mx + HiZ::size && y1 == my + HiZ::size)
+                    hiz->at(mx, my) = std::min(hiz->at(mx, my), triMaxZ);
+            }
+        }
+
+        if (stats) {
+            stats->tested += tested;
+            stats->passed += passed;
+            stats->shaded += shaded;
+            stats->hizCulled += hizCulled;
+        }
+    }
+
+    // Multisampled version of drawClipped: coverage and depth are tested at the 4 sample positions
+    // of each pixel, the shader runs once per pixel (at the pixel's sample point) and its colour is
+    // written to every sample that passed. The tile is resolved into the canvas by the caller.
+    // Input Variables:
+    // - renderer: Renderer object (canvas bounds)
+    // - ctx: Lights for shading (view space) including the tile's culled light list
+    // - mat: Surface coefficients and texture
+    // - tile: Sample storage for the tile being drawn (tile.x0 must be a multiple of 4)
+    // - stats: Counters to add to (optional, a pixel counts once however many of its samples pass)
+    template <typename Shader>
+    void drawClippedMSAA(Renderer& renderer, const ShadeContext& ctx, const Material& mat, SampleTile& tile, RasterStats* stats = nullptr) {
+        if (stats) stats->triangles++;
+        FixedEdges edges;
+        if (!edges.setup(v)) {
+            if (stats) stats->rejected++;
+            return;
+        }
+
+        //samples reach up to 3/8 of a pixel either side of the pixel
+        int startX, startY, endX, endY;
+        edges.pixelBounds(1, startX, startY, endX, endY);
+        startX = std::max(startX, tile.x0);
+        startY = std::max(startY, tile.y0);
+        endX = std::min(endX, tile.x0 + (int)tile.w);
+        endY = std::min(endY, tile.y0 + (int)tile.h);
+
+        //skip triangles outside
+        if (endX <= startX || endY <= startY) {
+            if (stats) stats->rejected++;
+            return;
+        }
+
+        int groupStartX = startX & ~3;
+        FixedEdges::Lanes lanes = edges.lanes();
+        long long rowE[3];
+        edges.at(groupStartX, startY, rowE);
+
+        //depth and shader setup once per triangle
+        const __m128 z0 = _mm_set1_ps(v[0].p[2]), z1 = _mm_set1_ps(v[1].p[2]), z2 = _mm_set1_ps(v[2].p[2]);
+        const typename Shader::Pixel shader(v, ctx, mat);
+
+        //edges and depth are linear in x and y, so each sample is the pixel value plus a constant
+        __m128i offE[SampleTile::samples][3];
+        __m128 offZ[SampleTile::samples];
+        int reach[3] = { INT_MIN, INT_MIN, INT_MIN };
+        for (unsigned int s = 0; s < SampleTile::samples; s++) {
+            int sx = (int)(SampleTile::offsets[s][0] * FixedEdges::subPixel), sy = (int)(SampleTile::offsets[s][1] * FixedEdges::subPixel);
+            float b[3];
+            for (unsigned int i = 0; i < 3; i++) {
+                int o = (int)(edges.ex[i] * sx + edges.ey[i] * sy);
+                offE[s][i] = _mm_set1_epi32(o);
+                b[i] = (float)o * edges.invArea;
+                //furthest any sample reaches outside each edge (for the whole pixel reject)
+                reach[i] = std::max(reach[i], o);
+            }
+            offZ[s] = lerp3(z0, z1, z2, _mm_set1_ps(b[0]), _mm_set1_ps(b[1]), _mm_set1_ps(b[2]));
+        }
+        const __m128i reach0 = _mm_set1_epi32(reach[0]), reach1 = _mm_set1_epi32(reach[1]), reach2 = _mm_set1_epi32(reach[2]);
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 minDepth = _mm_set1_ps(0.001f);
+        const __m128i outside = _mm_set1_epi32(-1);
+        const __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+        const __m128i vStartX = _mm_set1_epi32(startX);
+        const __m128i vEndX = _mm_set1_epi32(endX);
+
+        //counters for the whole triangle (added to stats at the end)
+        unsigned int tested = 0, passed = 0, shaded = 0;
+        unsigned int* overdraw = stats ? stats->overdraw : nullptr;
+
+        for (int y = startY; y < endY; y++) {
+            unsigned int ly = y - tile.y0;
+            const __m128 py = _mm_set1_ps((float)y);
+
+            long long e[3] = { rowE[0], rowE[1], rowE[2] };
+            for (int x = groupStartX; x < endX; x += 4) {
+                unsigned int lx = x - tile.x0;
+                __m128i xi = _mm_add_epi32(_mm_set1_epi32(x), lane);
+                __m128i inBox = _mm_andnot_si128(_mm_cmplt_epi32(xi, vStartX), _mm_cmplt_epi32(xi, vEndX));
+
+                //edge values at the pixel's sample point
+                __m128i e0 = _mm_add_epi32(_mm_set1_epi32(FixedEdges::narrow(e[0])), lanes.e[0]);
+                __m128i e1 = _mm_add_epi32(_mm_set1_epi32(FixedEdges::narrow(e[1])), lanes.e[1]);
+                __m128i e2 = _mm_add_epi32(_mm_set1_epi32(FixedEdges::narrow(e[2])), lanes.e[2]);
+
+                //no sample of any of the 4 pixels can be inside
+                __m128i near = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(e0, reach0), outside), _mm_cmpgt_epi32(_mm_add_epi32(e1, reach1), outside)),
+                    _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(e2, reach2), outside), inBox));
+                if (_mm_movemask_ps(_mm_castsi128_ps(near)) == 0) {
+                    edges.stepX(e);
+                    continue;
+                }
+
+                //barycentrics at the pixel's sample point
+                __m128 alpha = _mm_add_ps(_mm_set1_ps((float)e[0] * edges.invArea), lanes.b[0]);
+                __m128 beta = _mm_add_ps(_mm_set1_ps((float)e[1] * edges.invArea), lanes.b[1]);
+                __m128 gamma = _mm_add_ps(_mm_set1_ps((float)e[2] * edges.invArea), lanes.b[2]);
+                edges.stepX(e);
+
+                //coverage + depth test per sample
+                __m128 depthC = lerp3(z0, z1, z2, alpha, beta, gamma);
+                __m128 pass[SampleTile::samples], depth[SampleTile::samples];
+                __m128 any = zero, anyIn = zero;
+                for (unsigned int s = 0; s < SampleTile::samples; s++) {
+                    __m128i in = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(e0, offE[s][0]), outside), _mm_cmpgt_epi32(_mm_add_epi32(e1, offE[s][1]), outside)),
+                        _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(e2, offE[s][2]), outside), inBox));
+                    depth[s] = _mm_add_ps(depthC, offZ[s]);
+                    __m128 zOld = _mm_load_ps(tile.depth.row(ly, s) + lx);
+                    pass[s] = _mm_and_ps(_mm_castsi128_ps(in), _mm_and_ps(_mm_cmpgt_ps(zOld, depth[s]), _mm_cmpgt_ps(depth[s], minDepth)));
+                    any = _mm_or_ps(any, pass[s]);
+                    anyIn = _mm_or_ps(anyIn, _mm_castsi128_ps(in));
+                }
+                tested += RasterStats::lanes(_mm_movemask_ps(anyIn));
+                int anyMask = _mm_movemask_ps(any);
+                if (anyMask == 0) continue;
+                passed += RasterStats::lanes(anyMask);
+                shaded += 4;
+
+                //shade once per pixel
+                __m128 px = _mm_cvtepi32_ps(xi);
+                colour4 col = shader.shade(alpha, beta, gamma, px, py, depthC);
+                __m128i pixels = col.toPacked();
+
+                //masked store into every sample that passed
+                for (unsigned int s = 0; s < SampleTile::samples; s++) {
+                    float* zrow = tile.depth.row(ly, s) + lx;
+                    __m128i* crow = reinterpret_cast<__m128i*>(tile.row(ly, s) + lx);
+                    __m128i passi = _mm_castps_si128(pass[s]);
+                    _mm_storeu_si128(crow, _mm_or_si128(_mm_and_si128(passi, pixels), _mm_andnot_si128(passi, _mm_loadu_si128(crow))));
+                    _mm_store_ps(zrow, _mm_or_ps(_mm_and_ps(pass[s], depth[s]), _mm_andnot_ps(pass[s], _mm_load_ps(zrow))));
+                }
+                //debug view - count the write
+                if (overdraw) {
+                    __m128i* count = reinterpret_cast<__m128i*>(overdraw + (size_t)y * stats->overdrawPitch + x);
+                    _mm_storeu_si128(count, _mm_sub_epi32(_mm_loadu_si128(count), _mm_castps_si128(any)));
                 }
             }
+            edges.stepY(rowE);
+        }
+
+        if (stats) {
+            stats->tested += tested;
+            stats->passed += passed;
+            stats->shaded += shaded;
         }
     }
 
@@ -226,3 +606,152 @@ public:
         std::cout << std::endl;
     }
 };
+
+// Micro triangles - snapped bounds covering at most 2x2 pixel sample points.
+// Up to four are set up together with one triangle per SIMD lane (snapping, edge functions, top-left
+// rule and the coverage/barycentrics of the four candidate pixels), then drawMicro depth tests and
+// shades each one as a single 2x2 group. No bounding box loop and no per-triangle rejection of
+// sub-pixel triangles, so dense distant meshes stay solid.
+struct MicroBatch {
+    static constexpr unsigned int size = 4;
+    const Vertex* tris[size];   // three screen space vertices per triangle
+    unsigned int count = 0;
+
+    // filled by setup()
+    int x0[size], y0[size];     // top left candidate pixel
+    int mask[size];             // covered candidates, bit k is pixel (x0 + (k & 1), y0 + (k >> 1))
+    __m128 alpha[size], beta[size], gamma[size]; // barycentrics of the four candidates
+
+    // Add a triangle, returns true when the batch is full
+    bool add(const Vertex* v) {
+        tris[count++] = v;
+        return count == size;
+    }
+
+    // Coverage of every triangle in the batch
+    // Input Variables:
+    // - clipX0, clipY0, clipX1, clipY1: Pixels that may be written (tile clipped to the canvas, end exclusive)
+    void setup(int clipX0, int clipY0, int clipX1, int clipY1) {
+        //gather to SoA (unused lanes repeat the first triangle and are masked off)
+        alignas(16) float vx[3][size], vy[3][size];
+        for (unsigned int t = 0; t < size; t++) {
+            const Vertex* v = tris[t < count ? t : 0];
+            for (unsigned int k = 0; k < 3; k++) {
+                vx[k][t] = v[k].p[0];
+                vy[k][t] = v[k].p[1];
+            }
+        }
+
+        //snap (integer valued floats from here on - all products are exact)
+        const __m128 sub = _mm_set1_ps((float)FixedEdges::subPixel);
+        __m128 X[3], Y[3];
+        for (unsigned int k = 0; k < 3; k++) {
+            X[k] = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(vx[k]), sub)));
+            Y[k] = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(vy[k]), sub)));
+        }
+
+        //first candidate pixel = ceil(min / 16)
+        const __m128i round = _mm_set1_epi32(FixedEdges::subPixel - 1);
+        __m128i px0 = _mm_srai_epi32(_mm_add_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_min_ps(X[0], X[1]), X[2])), round), FixedEdges::subBits);
+        __m128i py0 = _mm_srai_epi32(_mm_add_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_min_ps(Y[0], Y[1]), Y[2])), round), FixedEdges::subBits);
+
+        //edge gradients, top-left edges and area (same as FixedEdges::setup)
+        const __m128 zero = _mm_setzero_ps();
+        __m128 ex[3], ey[3], topLeft[3];
+        for (unsigned int i = 0; i < 3; i++) {
+            unsigned int j = (i + 1) % 3;
+            ex[i] = _mm_sub_ps(Y[i], Y[j]);
+            ey[i] = _mm_sub_ps(X[j], X[i]);
+            topLeft[i] = _mm_or_ps(_mm_cmpgt_ps(ex[i], zero), _mm_and_ps(_mm_cmpeq_ps(ex[i], zero), _mm_cmpgt_ps(ey[i], zero)));
+        }
+        __m128 area = _mm_add_ps(_mm_mul_ps(ex[0], _mm_sub_ps(X[2], X[0])), _mm_mul_ps(ey[0], _mm_sub_ps(Y[2], Y[0])));
+        __m128 valid = _mm_and_ps(_mm_cmpgt_ps(area, zero), _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(count), _mm_set_epi32(3, 2, 1, 0))));
+        __m128 invArea = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(area, _mm_set1_ps(1.0f)));
+
+        //the four candidates
+        __m128 a[4], b[4], c[4];
+        int m[4];
+        for (unsigned int k = 0; k < 4; k++) {
+            __m128i cx = _mm_add_epi32(px0, _mm_set1_epi32(k & 1));
+            __m128i cy = _mm_add_epi32(py0, _mm_set1_epi32(k >> 1));
+            __m128 sx = _mm_mul_ps(_mm_cvtepi32_ps(cx), sub), sy = _mm_mul_ps(_mm_cvtepi32_ps(cy), sub);
+            __m128 e[3];
+            __m128 in = valid;
+            for (unsigned int i = 0; i < 3; i++) {
+                e[i] = _mm_add_ps(_mm_mul_ps(ex[i], _mm_sub_ps(sx, X[i])), _mm_mul_ps(ey[i], _mm_sub_ps(sy, Y[i])));
+                __m128 inEdge = _mm_or_ps(_mm_and_ps(topLeft[i], _mm_cmpge_ps(e[i], zero)), _mm_andnot_ps(topLeft[i], _mm_cmpgt_ps(e[i], zero)));
+                in = _mm_and_ps(in, inEdge);
+            }
+            __m128i clip = _mm_and_si128(_mm_andnot_si128(_mm_cmplt_epi32(cx, _mm_set1_epi32(clipX0)), _mm_cmplt_epi32(cx, _mm_set1_epi32(clipX1))),
+                _mm_andnot_si128(_mm_cmplt_epi32(cy, _mm_set1_epi32(clipY0)), _mm_cmplt_epi32(cy, _mm_set1_epi32(clipY1))));
+            m[k] = _mm_movemask_ps(_mm_and_ps(in, _mm_castsi128_ps(clip)));
+            a[k] = _mm_mul_ps(e[0], invArea);
+            b[k] = _mm_mul_ps(e[1], invArea);
+            c[k] = _mm_mul_ps(e[2], invArea);
+        }
+
+        //lanes are triangles above, transpose so each triangle has its four candidates in lanes
+        _MM_TRANSPOSE4_PS(a[0], a[1], a[2], a[3]);
+        _MM_TRANSPOSE4_PS(b[0], b[1], b[2], b[3]);
+        _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+        alignas(16) int ox[size], oy[size];
+        _mm_store_si128(reinterpret_cast<__m128i*>(ox), px0);
+        _mm_store_si128(reinterpret_cast<__m128i*>(oy), py0);
+        for (unsigned int t = 0; t < size; t++) {
+            x0[t] = ox[t];
+            y0[t] = oy[t];
+            mask[t] = ((m[0] >> t) & 1) | (((m[1] >> t) & 1) << 1) | (((m[2] >> t) & 1) << 2) | (((m[3] >> t) & 1) << 3);
+            alpha[t] = a[t];
+            beta[t] = b[t];
+            gamma[t] = c[t];
+        }
+    }
+};
+
+// Depth test and shade one triangle of a MicroBatch (after setup) as a 2x2 pixel group
+// Input Variables:
+// - renderer: Renderer object for drawing
+// - ctx: Lights for shading (view space) including the tile's culled light list
+// - mat: Surface coefficients and texture
+// - batch: Batch holding the triangle
+// - t: Index of the triangle in the batch
+// - stats: Counters to add to (optional)
+template <typename Shader>
+void drawMicro(Renderer& renderer, const ShadeContext& ctx, const Material& mat, const MicroBatch& batch, unsigned int t, RasterStats* stats = nullptr) {
+    int m = batch.mask[t];
+    if (stats) {
+        stats->triangles++;
+        stats->tested += RasterStats::lanes(m);
+        if (m == 0) stats->rejected++;
+    }
+    if (m == 0) return;
+    const Vertex* v = batch.tris[t];
+    int x = batch.x0[t], y = batch.y0[t];
+
+    //depth test the covered candidates
+    __m128 depth = lerp3(_mm_set1_ps(v[0].p[2]), _mm_set1_ps(v[1].p[2]), _mm_set1_ps(v[2].p[2]), batch.alpha[t], batch.beta[t], batch.gamma[t]);
+    alignas(16) float d[4];
+    _mm_store_ps(d, depth);
+    int pass = 0;
+    for (int k = 0; k < 4; k++) {
+        if (((m >> k) & 1) && renderer.zbuffer(x + (k & 1), y + (k >> 1)) > d[k] && d[k] > 0.001f) pass |= 1 << k;
+    }
+    if (pass == 0) return;
+    if (stats) {
+        stats->passed += RasterStats::lanes(pass);
+        stats->shaded += 4;
+    }
+
+    //shade the 2x2 group in one go
+    const typename Shader::Pixel shader(v, ctx, mat);
+    __m128 px = _mm_set_ps((float)(x + 1), (float)x, (float)(x + 1), (float)x);
+    __m128 py = _mm_set_ps((float)(y + 1), (float)(y + 1), (float)y, (float)y);
+    alignas(16) unsigned int pixels[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(pixels), shader.shade(batch.alpha[t], batch.beta[t], batch.gamma[t], px, py, depth).toPacked());
+    for (int k = 0; k < 4; k++) {
+        if (!((pass >> k) & 1)) continue;
+        renderer.canvas.getRow(y + (k >> 1))[x + (k & 1)] = pixels[k];
+        renderer.zbuffer(x + (k & 1), y + (k >> 1)) = d[k];
+        if (stats && stats->overdraw) stats->overdraw[(size_t)(y + (k >> 1)) * stats->overdrawPitch + x + (k & 1)]++;
+    }
+}
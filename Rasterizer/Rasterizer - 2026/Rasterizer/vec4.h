@@ -1,17 +1,28 @@
 #pragma once
 
 #include <iostream>
+#include <cmath>
+#include <immintrin.h>
 
 // The `vec4` class represents a 4D vector and provides operations such as scaling, addition, subtraction, 
 // normalization, and vector products (dot and cross).
-class vec4 {
+// 16-byte aligned with the components in one SSE register, so every operation is a handful of SSE
+// instructions. The arithmetic is done in the same order as the scalar formulas, so results are
+// bit-identical to them.
+class alignas(16) vec4 {
     union {
         struct {
             float x, y, z, w; // Components of the vector
         };
         float v[4];           // Array representation of the vector components
+        __m128 m;             // SSE register view
     };
 
+    // Lanes x, y, z set, w clear (for the operations that return w = 0)
+    static __m128 xyzMask() {
+        return _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    }
+
 public:
     // Constructor to initialize the vector with specified values.
     // Default values: x = 0, y = 0, z = 0, w = 1.
@@ -21,7 +32,15 @@ public:
     // - _z: Z component of the vector
     // - _w: W component of the vector (default is 1.0)
     vec4(float _x = 0.f, float _y = 0.f, float _z = 0.f, float _w = 1.f)
-        : x(_x), y(_y), z(_z), w(_w) {}
+        : m(_mm_setr_ps(_x, _y, _z, _w)) {}
+
+    // Constructor from an SSE register (lanes x, y, z, w).
+    explicit vec4(__m128 _m) : m(_m) {}
+
+    // The components as an SSE register (lanes x, y, z, w).
+    __m128 simd() const {
+        return m;
+    }
 
     // Displays the components of the vector in a readable format.
     void display() {
@@ -33,16 +52,14 @@ public:
     // - scalar: Value to scale the vector by
     // Returns a new scaled `vec4`.
     vec4 operator*(float scalar) const {
-        return { x * scalar, y * scalar, z * scalar, w * scalar };
+        return vec4(_mm_mul_ps(m, _mm_set1_ps(scalar)));
     }
 
     // Divides the vector by its W component and sets W to 1.
     // Useful for normalizing the W component after transformations.
     void divideW() {
-        x /= w;
-        y /= w;
-        z /= w;
-        w = 1.f;
+        __m128 d = _mm_div_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(3, 3, 3, 3)));
+        m = _mm_or_ps(_mm_and_ps(d, xyzMask()), _mm_andnot_ps(xyzMask(), _mm_set1_ps(1.f)));
     }
 
     // Accesses a vector component by index.
@@ -66,7 +83,7 @@ public:
     // - other: The vector to subtract
     // Returns a new `vec4` resulting from the subtraction.
     vec4 operator-(const vec4& other) const {
-        return vec4(x - other.x, y - other.y, z - other.z, 0.0f);
+        return vec4(_mm_and_ps(_mm_sub_ps(m, other.m), xyzMask()));
     }
 
     // Adds another vector to this vector.
@@ -74,7 +91,7 @@ public:
     // - other: The vector to add
     // Returns a new `vec4` resulting from the addition.
     vec4 operator+(const vec4& other) const {
-        return vec4(x + other.x, y + other.y, z + other.z, 0.0f);
+        return vec4(_mm_and_ps(_mm_add_ps(m, other.m), xyzMask()));
     }
 
     // Computes the cross product of two vectors.
@@ -83,12 +100,12 @@ public:
     // - v2: The second vector
     // Returns a new `vec4` representing the cross product.
     static vec4 cross(const vec4& v1, const vec4& v2) {
-        return vec4(
-            v1.y * v2.z - v1.z * v2.y,
-            v1.z * v2.x - v1.x * v2.z,
-            v1.x * v2.y - v1.y * v2.x,
-            0.0f // The W component is set to 0 for cross products
-        );
+        //(y, z, x) * (z, x, y) - (z, x, y) * (y, z, x), the W component is set to 0 for cross products
+        __m128 a1 = _mm_shuffle_ps(v1.m, v1.m, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b1 = _mm_shuffle_ps(v2.m, v2.m, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 a2 = _mm_shuffle_ps(v1.m, v1.m, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 b2 = _mm_shuffle_ps(v2.m, v2.m, _MM_SHUFFLE(3, 0, 2, 1));
+        return vec4(_mm_and_ps(_mm_sub_ps(_mm_mul_ps(a1, b1), _mm_mul_ps(a2, b2)), xyzMask()));
     }
 
     // Computes the dot product of two vectors.
@@ -97,15 +114,32 @@ public:
     // - v2: The second vector
     // Returns the dot product as a float.
     static float dot(const vec4& v1, const vec4& v2) {
-        return (v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z);
+        return _mm_cvtss_f32(dot3(v1.m, v2.m));
+    }
+
+    // Dot product of the x, y, z lanes, (x + y) + z like the scalar version
+    // Returns the sum in the lowest lane.
+    static __m128 dot3(__m128 a, __m128 b) {
+        __m128 p = _mm_mul_ps(a, b);
+        __m128 s = _mm_add_ss(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_add_ss(s, _mm_movehl_ps(p, p));
     }
 
     // Normalizes the vector to make its length equal to 1.
     // This operation does not affect the W component.
     void normalise() {
-        float length = std::sqrt(x * x + y * y + z * z);
-        x /= length;
-        y /= length;
-        z /= length;
+        __m128 length = _mm_sqrt_ss(dot3(m, m));
+        __m128 d = _mm_div_ps(m, _mm_shuffle_ps(length, length, 0));
+        m = _mm_or_ps(_mm_and_ps(d, xyzMask()), _mm_andnot_ps(xyzMask(), m));
+    }
+
+    // Normalizes the vector using the hardware reciprocal square root plus one
+    // Newton-Raphson step (about 23 bits of precision), avoiding the sqrt and divides.
+    // This operation does not affect the W component.
+    void normaliseFast() {
+        float len2 = _mm_cvtss_f32(dot3(m, m));
+        float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(len2)));
+        r = r * (1.5f - 0.5f * len2 * r * r);
+        m = _mm_or_ps(_mm_and_ps(_mm_mul_ps(m, _mm_set1_ps(r)), xyzMask()), _mm_andnot_ps(xyzMask(), m));
     }
 };
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <concepts>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include "dispatch.h"
 
 // Zbuffer class for managing depth values during rendering.
 // This class is template-constrained to only work with floating-point types (`float` or `double`).
@@ -9,6 +14,10 @@ template<std::floating_point T> // Restricts T to be a floating-point type
 class Zbuffer {
     T* buffer;                  // Pointer to the buffer storing depth values - can also use unique_ptr []here
     unsigned int width, height; // Dimensions of the Z-buffer
+    unsigned int stride;        // Row length in elements (padded to 64 bytes so SIMD rows never cross into the next row)
+    unsigned int samples;       // Depth samples per pixel (1, or 4 for multisampling)
+
+    static constexpr std::align_val_t alignment{ 64 };
 
 public:
     // Constructor to initialize a Z-buffer with the given width and height.
@@ -16,12 +25,13 @@ public:
     // Input Variables:
     // - w: Width of the Z-buffer.
     // - h: Height of the Z-buffer.
-    Zbuffer(unsigned int w, unsigned int h) : buffer(nullptr) {
-        create(w, h);
+    // - s: Depth samples per pixel (default 1).
+    Zbuffer(unsigned int w, unsigned int h, unsigned int s = 1) : buffer(nullptr) {
+        create(w, h, s);
     }
 
     // Default constructor for creating an uninitialized Z-buffer.
-    Zbuffer() {
+    Zbuffer() : buffer(nullptr), width(0), height(0), stride(0), samples(1) {
     }
 
     // Creates or reinitialies the Z-buffer with the given width and height.
@@ -29,11 +39,16 @@ public:
     // Input Variables:
     // - w: Width of the Z-buffer.
     // - h: Height of the Z-buffer.
-    void create(unsigned int w, unsigned int h) {
+    // - s: Depth samples per pixel (default 1).
+    // Each sample gets its own row (row y of sample k is stored at y * s + k), so four neighbouring pixels
+    // of one sample are still contiguous for SIMD.
+    void create(unsigned int w, unsigned int h, unsigned int s = 1) {
         width = w;
         height = h;
-        if (buffer != nullptr) delete[] buffer; // remove previous version
-        buffer = new T[width * height]; // Allocate memory for the buffer
+        samples = s;
+        stride = (width + (64 / sizeof(T)) - 1) & ~((64 / sizeof(T)) - 1);
+        release(); // remove previous version
+        buffer = static_cast<T*>(::operator new[](stride * height * samples * sizeof(T), alignment)); // Allocate aligned memory for the buffer
     }
 
     // Accesses the depth value at the specified (x, y) coordinate.
@@ -42,16 +57,34 @@ public:
     // - y: Y-coordinate of the pixel.
     // Returns a reference to the depth value at (x, y).
     T& operator () (unsigned int x, unsigned int y) {
-        return buffer[(y * width) + x]; // Convert 2D coordinates to 1D index
+        return buffer[(y * samples * stride) + x]; // Convert 2D coordinates to 1D index (sample 0)
+    }
+
+    // Returns a pointer to the first depth value of row y.
+    // Rows are 64 byte aligned and padded, so reading up to the next multiple of 16 floats is safe.
+    T* row(unsigned int y) {
+        return buffer + (y * samples * stride);
+    }
+
+    // Returns a pointer to the first depth value of sample s in row y.
+    T* row(unsigned int y, unsigned int s) {
+        return buffer + ((y * samples + s) * stride);
+    }
+
+    // Number of depth samples per pixel
+    unsigned int getSamples() const {
+        return samples;
     }
 
     // Clears the Z-buffer by setting all depth values to 1.0f,
     // which represents the farthest possible depth.
     void clear() {
-        // could also use fill_n
-        for (unsigned int i = 0; i < width * height; i++) {
-            buffer[i] = T(1.0); // Reset each depth value
-        }
+        fill(buffer, stride * height * samples); // Reset each depth value
+    }
+
+    // Clears rows y0 to y1 - 1 only (every sample) - lets several threads each clear a band.
+    void clearRows(unsigned int y0, unsigned int y1) {
+        fill(row(y0), stride * (y1 - y0) * samples);
     }
 
     // remove copying
@@ -60,22 +93,62 @@ public:
 
     // Destructor to clean up memory allocated for the Z-buffer.
     ~Zbuffer() {
-        delete[] buffer; // Free the allocated memory
+        release(); // Free the allocated memory
     }
 
     // move operators just in case
-    Zbuffer(Zbuffer&& other) noexcept : buffer(other.buffer), width(other.width), height(other.height) {
+    Zbuffer(Zbuffer&& other) noexcept : buffer(other.buffer), width(other.width), height(other.height), stride(other.stride), samples(other.samples) {
         other.buffer = nullptr;
     }
 
     Zbuffer& operator=(Zbuffer&& other) noexcept {
         if (this != &other) {
-            delete[] buffer;
+            release();
             buffer = other.buffer;
             width = other.width;
             height = other.height;
+            stride = other.stride;
+            samples = other.samples;
             other.buffer = nullptr;
         }
         return *this;
     }
+
+private:
+    // Sets count depth values to the far plane (float buffers use the CPU's widest fill kernel)
+    static void fill(T* dst, size_t count) {
+        if constexpr (std::is_same_v<T, float>) SimdKernels::active().fill(dst, count, 1.0f);
+        else std::fill_n(dst, count, T(1.0));
+    }
+
+    // Frees the aligned allocation (if any)
+    void release() {
+        if (buffer != nullptr) ::operator delete[](buffer, alignment);
+        buffer = nullptr;
+    }
+};
+
+// Hierarchical depth for the tile rasterizer - the farthest depth of each 8x8 micro tile.
+// Values are conservative: a micro tile's entry is never nearer than any depth inside it, so a
+// triangle whose nearest depth is not in front of it cannot pass the depth test anywhere in it.
+class HiZ {
+    std::vector<float> maxZ;    // one entry per micro tile
+    unsigned int width = 0;     // micro tiles across
+    unsigned int height = 0;    // micro tiles down
+
+public:
+    static constexpr int size = 8; // micro tile width/height in pixels (multiple of 4)
+
+    // Size for a w x h pixel buffer and reset every micro tile to the far plane
+    // (call once per frame with the zbuffer clear - keeps its memory when the size does not change)
+    void create(unsigned int w, unsigned int h) {
+        width = (w + size - 1) / size;
+        height = (h + size - 1) / size;
+        maxZ.assign(width * height, 1.0f);
+    }
+
+    // Farthest depth of the micro tile containing pixel (x, y)
+    float& at(int x, int y) {
+        return maxZ[(y / size) * width + (x / size)];
+    }
 };